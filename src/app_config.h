@@ -0,0 +1,167 @@
+#pragma once
+#include <Arduino.h>
+
+// ===== Network/oneM2M Settings =====
+static const char* const WIFI_SSID     = "your_id";       // Replace with your Wi-Fi SSID
+static const char* const WIFI_PASSWORD = "your_password"; // Replace with your Wi-Fi password
+
+// Mobius connection (Server certificate CN/SAN must match on every endpoint)
+// Ordered CSE endpoints, first preferred; the config container can replace them
+static const char* const MOBIUS_ENDPOINTS[] = { "https://yourIP:443" };
+static const char* const CSEBASE     = "Mobius";
+
+// Internal HTTP server (notify reception)
+static const uint16_t NOTIFY_PORT = 8080;
+
+// Whole-tank command container under every AE (state vector / scene trigger)
+static const char* const CNT_ALL = "all";
+
+// Remote configuration container under every AE (see remote_config.h)
+static const char* const CNT_CONFIG = "config";
+
+// Firmware update command container, only under the first AE (device-wide)
+static const char* const CNT_OTA = "ota";
+// HMAC-SHA256 key that signs delta headers (tools/ota_delta.py make ... <key>)
+static const char* const OTA_SIGN_KEY = "change-me-ota";
+
+// ===== Mobius Circuit Breaker =====
+// Per endpoint: after M2M_CIRCUIT_FAILS consecutive transport/5xx failures it
+// is skipped for M2M_CIRCUIT_COOLDOWN_MS, then one probe request is let through.
+static const uint8_t M2M_CIRCUIT_FAILS = 3;
+static const unsigned long M2M_CIRCUIT_COOLDOWN_MS = 30000;
+
+// ===== Mobius Endpoint Selection =====
+static const uint8_t M2M_MAX_ENDPOINTS = 4;
+static const int32_t M2M_CONNECT_TIMEOUT_MS = 700;   // dead host -> failover
+static const uint16_t M2M_READ_TIMEOUT_MS = 4000;
+static const uint32_t M2M_TLS_TIMEOUT_S = 3;
+static const uint16_t M2M_SWITCH_MARGIN_PCT = 150;   // score gap before leaving a live session
+
+// ===== Store-and-Forward Journal (LittleFS) =====
+static const size_t  JOURNAL_SEG_BYTES     = 8 * 1024; // one segment file
+static const uint8_t JOURNAL_MAX_SEGS      = 8;        // oldest segment dropped beyond this
+static const size_t  JOURNAL_WBUF_BYTES    = 512;      // RAM batch before a flash append
+static const unsigned long JOURNAL_FLUSH_MS = 2000;    // max age of buffered records
+static const uint8_t JOURNAL_DRAIN_BATCH   = 8;        // records replayed per cursor write
+
+// ===== State Reporting =====
+// Hourly/daily on-time and energy summaries (see energy.h)
+static const char* const CNT_ENERGY = "energy";
+
+// Relay transitions are posted as one CIN per burst to <ae>/<CNT_STATE>
+static const char* const CNT_STATE = "state";
+static const unsigned long REPORT_DEBOUNCE_MS  = 300;   // quiet time that ends a burst
+static const unsigned long REPORT_MAX_DELAY_MS = 3000;  // upper bound while changes keep coming
+static const unsigned long REPORT_RETRY_MS     = 10000; // when the journal cannot take it either
+
+// ===== Diagnostics (see diagnostics.h) =====
+// Compact health snapshot CINs to <first ae>/<CNT_DIAG>. The interval doubles
+// from DIAG_MIN_INTERVAL_MS up to DIAG_MAX_INTERVAL_MS while nothing changes
+// and an anomaly reports at once (at most once per DIAG_ANOMALY_GAP_MS).
+static const char* const CNT_DIAG = "diag";
+static const unsigned long DIAG_MIN_INTERVAL_MS = 5UL * 60UL * 1000UL;
+static const unsigned long DIAG_MAX_INTERVAL_MS = 60UL * 60UL * 1000UL;
+static const unsigned long DIAG_ANOMALY_GAP_MS  = 60UL * 1000UL;
+static const unsigned long DIAG_STALL_MS        = 200;   // loop pass counted as a stall
+static const unsigned long DIAG_STALL_FLUSH_MS  = 2000;  // one pass this long is an anomaly
+static const uint32_t DIAG_HEAP_LOW = 32UL * 1024UL;     // free heap below this is an anomaly
+static const int8_t DIAG_RSSI_LOW = -82;                 // dBm
+
+// ===== LAN Control API =====
+// PUT/GET /ch/[<ae>/]<channel> on the notify server, header
+// "Authorization: Bearer <token>" (?token= on /events only). Empty token
+// disables the API.
+static const char* const LAN_API_TOKEN = "change-me";
+
+// ===== UDP Control (binary frames, see udp_control.h) =====
+static const uint16_t UDP_CONTROL_PORT = 9750;       // 0 disables the listener
+static const char* const UDP_CONTROL_KEY = "change-me-too"; // HMAC-SHA256 key
+static const uint32_t UDP_MAX_SKEW_S = 30;           // frame time vs device clock
+
+// ===== Subscription Mode =====
+// true : one <grp> over the control containers per AE and one subscription
+//        created through its fan-out point (fopt); notifications for all
+//        channels arrive on /n/<ae> and are demultiplexed by "sur"
+// false: one subscription per container, notified on /n/<ae>/<cnt>
+static const bool USE_GROUP_SUBSCRIPTION = true;
+static const char* const GRP_CTRL_RN = "grp_ctrl";
+static const char* const SUB_CTRL_RN = "sub_ctrl";
+
+// Subscription lifetime: every sub is created with an explicit et and renewed
+// in the background at SUB_RENEW_PCT of it, tanks staggered over the rest of
+// the window. Every sub is also re-read once per SUB_CHECK_MS cycle so one
+// lost on the server is recreated instead of leaving the channel to polling.
+static const uint32_t SUB_LIFETIME_S = 24UL * 3600UL;
+static const uint8_t SUB_RENEW_PCT = 75;
+static const unsigned long SUB_CHECK_MS = 5UL * 60UL * 1000UL;
+
+// Subscriptions ask for the latest pending notification only (pn=1, ln).
+// A notification whose ct is older than this is acknowledged without
+// actuating; the container's latest CIN is retrieved once instead.
+static const uint32_t NOTIFY_BACKLOG_S = 60;
+
+// ===== Polling Settings =====
+// One scheduler serves every tank: the interval is spread over all channels
+// (default, can be changed at runtime through the config container)
+static const unsigned long POLL_INTERVAL_MS = 15UL * 1000UL;
+// Polls are conditional retrieves (fu=2, cra=<ct of the last applied CIN>),
+// so an unchanged container answers 404 without a CIN. Every
+// POLL_FULL_EVERY-th round is unconditional, for CINs created within the
+// same second.
+static const uint8_t POLL_FULL_EVERY = 8;
+
+// ===== FEEDER Pulse =====
+// Default pulse width of CH_PULSE channels (per channel through config)
+static const unsigned long FEED_PULSE_MS = 2000;
+
+// ===== Read-only configuration image =====
+// Large tables (scenes, base channel config) built by tools/cfg_image.py
+// and flashed to their own partition (partitions.csv), read in place
+static const char* const CFGIMG_LABEL = "cfgimg";
+static const uint8_t CFGIMG_SUBTYPE = 0x40;
+
+// ===== Relay Logic =====
+static const bool RELAY_ACTIVE_LOW = true; // Most relays are active-LOW
+
+// ===== Tank (AE) Table =====
+// Each AE is one aquarium with its own containers and relay channels.
+// All AEs share the TLS session, the notify server and the poll scheduler.
+enum ChannelKind : uint8_t {
+  CH_LEVEL, // on/off follows the latest CIN
+  CH_PULSE  // "on" fires a FEED_PULSE_MS pulse once per CIN, "off" is ignored
+};
+
+struct ChannelConfig {
+  const char* cnt;  // container (control command reception)
+  const char* name; // log tag, also gives the subscription name "sub_<name>"
+  int pin;
+  ChannelKind kind;
+  uint16_t watts;   // load for energy estimates, 0 = unknown (also set via config)
+};
+
+struct AeConfig {
+  const char* ae;     // AE resource name (Assumed created in advance)
+  const char* origin; // X-M2M-Origin (Recommended to match AE name / server ACP)
+  const ChannelConfig* ch;
+  uint8_t nch;
+};
+
+static const ChannelConfig TANK0_CHANNELS[] = {
+  { "LED",    "LED",    25, CH_LEVEL }, // CH1
+  { "feed",   "FEEDER", 26, CH_PULSE }, // CH2
+  { "heater", "HEATER", 27, CH_LEVEL }, // CH3
+  { "pump",   "PUMP",   33, CH_LEVEL }, // CH4
+};
+
+// A second tank on the same controller only needs its own pins, e.g.
+// static const ChannelConfig TANK1_CHANNELS[] = {
+//   { "LED",    "LED",    16, CH_LEVEL },
+//   { "feed",   "FEEDER", 17, CH_PULSE },
+//   { "heater", "HEATER", 18, CH_LEVEL },
+//   { "pump",   "PUMP",   19, CH_LEVEL },
+// };
+
+static const AeConfig AE_TABLE[] = {
+  { "AE-Actuator", "SM", TANK0_CHANNELS, sizeof(TANK0_CHANNELS) / sizeof(TANK0_CHANNELS[0]) },
+  // { "AE-Actuator2", "SM2", TANK1_CHANNELS, sizeof(TANK1_CHANNELS) / sizeof(TANK1_CHANNELS[0]) },
+};
@@ -0,0 +1,107 @@
+#include "cfg_image.h"
+#include "app_config.h"
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+
+static const size_t CFG_HDR = 32;
+
+struct CfgHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t size;
+  uint32_t crc;
+  uint16_t ntables;
+  uint16_t reserved;
+  uint8_t pad[12];
+};
+
+static const uint8_t* img = nullptr;   // mapped image, nullptr if absent
+static spi_flash_mmap_handle_t mapHandle;
+
+static const CfgHeader* header() {
+  return (const CfgHeader*)img;
+}
+
+static const CfgTable* directory() {
+  return (const CfgTable*)(img + CFG_HDR);
+}
+
+static bool tablesValid(const CfgHeader& h) {
+  if (CFG_HDR + (size_t)h.ntables * sizeof(CfgTable) > h.size) return false;
+  const CfgTable* dir = directory();
+  for (uint16_t i = 0; i < h.ntables; i++) {
+    const CfgTable& t = dir[i];
+    if (t.keyLen == 0 || t.keyLen > t.recSize) return false;
+    if (t.offset > h.size || (uint64_t)t.count * t.recSize > h.size - t.offset) return false;
+  }
+  return true;
+}
+
+bool cfgImageInit() {
+  const esp_partition_t* part = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)CFGIMG_SUBTYPE, CFGIMG_LABEL);
+  if (!part) { Serial.println("[CFGIMG] no partition"); return false; }
+
+  CfgHeader h;
+  if (esp_partition_read(part, 0, &h, sizeof(h)) != ESP_OK || memcmp(h.magic, "9PC1", 4) ||
+      h.size < CFG_HDR || h.size > part->size) {
+    Serial.println("[CFGIMG] no image");
+    return false;
+  }
+
+  const void* p = nullptr;
+  esp_err_t err = esp_partition_mmap(part, 0, h.size, SPI_FLASH_MMAP_DATA, &p, &mapHandle);
+  if (err != ESP_OK) { Serial.printf("[CFGIMG] mmap failed (%s)\n", esp_err_to_name(err)); return false; }
+  img = (const uint8_t*)p;
+
+  // One pass over the mapped flash at boot, no copy
+  if (esp_rom_crc32_le(0, img + CFG_HDR, h.size - CFG_HDR) != h.crc || !tablesValid(h)) {
+    Serial.println("[CFGIMG] corrupt image");
+    spi_flash_munmap(mapHandle);
+    img = nullptr;
+    return false;
+  }
+  Serial.printf("[CFGIMG] v%u, %u bytes, %u tables\n", h.version, h.size, h.ntables);
+  return true;
+}
+
+uint32_t cfgImageVersion() {
+  return img ? header()->version : 0;
+}
+
+const CfgTable* cfgTable(const char* name) {
+  if (!img) return nullptr;
+  const CfgTable* dir = directory();
+  for (uint16_t i = 0; i < header()->ntables; i++) {
+    if (!strncmp(dir[i].name, name, sizeof(dir[i].name))) return &dir[i];
+  }
+  return nullptr;
+}
+
+const uint8_t* cfgFind(const CfgTable* tbl, const char* key) {
+  if (!tbl || strlen(key) >= tbl->keyLen) return nullptr;
+  const uint8_t* base = img + tbl->offset;
+  uint32_t lo = 0, hi = tbl->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    const uint8_t* rec = base + (size_t)mid * tbl->recSize;
+    int c = strncmp(key, (const char*)rec, tbl->keyLen);
+    if (c == 0) return rec + tbl->keyLen;
+    if (c < 0) hi = mid; else lo = mid + 1;
+  }
+  return nullptr;
+}
+
+bool cfgBlob(const char* table, const char* key, const char*& data, size_t& len) {
+  const CfgTable* tbl = cfgTable(table);
+  if (!tbl || tbl->recSize < tbl->keyLen + 8) return false;
+  const uint8_t* v = cfgFind(tbl, key);
+  if (!v) return false;
+  uint32_t off, n;
+  memcpy(&off, v, 4);
+  memcpy(&n, v + 4, 4);
+  if (off > header()->size || n > header()->size - off) return false;
+  data = (const char*)img + off;
+  len = n;
+  return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+
+// =========================
+// Read-only configuration image (flash partition, memory-mapped)
+// =========================
+// Built on the host from JSON with tools/cfg_image.py and written to the
+// CFGIMG_LABEL partition. It is mapped into the data address space once at
+// boot and read in place: lookups cost no RAM and nothing is parsed up front.
+//
+//   header  "9PC1" | version u32 | size u32 | crc32 u32 (bytes 32..size)
+//           | ntables u16 | 0 u16 | pad[12]
+//   dir     ntables x { name[16] | offset u32 | count u32 | recSize u16
+//                       | keyLen u16 | 0 u32 }
+//   records count x recSize bytes, a NUL-padded key of keyLen bytes followed
+//           by the value, sorted by key (binary search)
+// Value layouts used by the firmware:
+//   "config"  key <ae>          blob: off u32 | len u32 -> config con JSON
+//   "scene"   key <ae>/<id>     blob: off u32 | len u32 -> state vector JSON
+
+struct CfgTable {
+  char name[16];
+  uint32_t offset;
+  uint32_t count;
+  uint16_t recSize;
+  uint16_t keyLen;
+  uint32_t reserved;
+};
+
+// Map and verify the partition. Without a valid image every lookup misses.
+bool cfgImageInit();
+
+uint32_t cfgImageVersion();
+
+const CfgTable* cfgTable(const char* name);
+
+// Value of the record with this key, nullptr if there is none
+const uint8_t* cfgFind(const CfgTable* tbl, const char* key);
+
+// Blob value (JSON text, NUL-terminated in the image)
+bool cfgBlob(const char* table, const char* key, const char*& data, size_t& len);
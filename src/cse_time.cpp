@@ -0,0 +1,80 @@
+#include "cse_time.h"
+#include <sys/time.h>
+
+// Estimated CSE clock minus device clock
+static int32_t skewMs = 0;
+static uint32_t skewN = 0;
+
+static int64_t epochMs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < 1700000000) return 0; // clock not set yet
+  return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+void cseClockSample(const String& date, unsigned long sentAtMs, uint32_t rttMs) {
+  if (rttMs > CSE_SKEW_MAX_RTT_MS) return;
+  int64_t now = epochMs();
+  if (!now) return;
+
+  // RFC 1123: "Sun, 06 Nov 1994 08:49:37 GMT", turned into a ct string
+  int d, y, hh, mm, ss;
+  char mon[4];
+  if (sscanf(date.c_str(), "%*3s, %d %3s %d %d:%d:%d", &d, mon, &y, &hh, &mm, &ss) != 6) return;
+  const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  const char* m = strstr(months, mon);
+  if (!m || (m - months) % 3) return;
+  char ct[20];
+  snprintf(ct, sizeof(ct), "%04d%02d%02dT%02d%02d%02d", y, (int)(m - months) / 3 + 1, d, hh, mm, ss);
+  uint32_t server = ctToEpoch(ct);
+  if (!server) return;
+
+  int64_t mid = now - (int64_t)(millis() - sentAtMs) + rttMs / 2;
+  int32_t sample = (int32_t)((int64_t)server * 1000 + 500 - mid);
+  skewMs = skewN ? skewMs + (sample - skewMs) / 16 : sample;
+  skewN++;
+}
+
+int32_t cseSkewMs() {
+  return skewMs;
+}
+
+uint32_t cseSkewSamples() {
+  return skewN;
+}
+
+time_t cseNow() {
+  time_t now = time(nullptr);
+  if (now < 1700000000) return 0;
+  return now + (skewMs + (skewMs < 0 ? -500 : 500)) / 1000;
+}
+
+String ctNow() {
+  time_t now = cseNow();
+  if (!now) return "";
+  struct tm tmv;
+  gmtime_r(&now, &tmv);
+  char buf[20];
+  strftime(buf, sizeof(buf), "%Y%m%dT%H%M%S", &tmv);
+  return buf;
+}
+
+// "YYYYMMDDTHHMMSS" -> epoch seconds (days from civil, no libc time zone)
+uint32_t ctToEpoch(const String& ct) {
+  if (ct.length() < 15) return 0;
+  const char* p = ct.c_str();
+  auto num = [p](int off, int len) { int v = 0; for (int i = 0; i < len; i++) v = v * 10 + (p[off + i] - '0'); return v; };
+  int y = num(0, 4), m = num(4, 2), d = num(6, 2);
+  y -= m <= 2;
+  int era = y / 400, yoe = y - era * 400;
+  int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  long days = (long)era * 146097 + doe - 719468;
+  return (uint32_t)(days * 86400L + num(9, 2) * 3600L + num(11, 2) * 60L + num(13, 2));
+}
+
+uint32_t fnv1a(const String& s) {
+  uint32_t h = 2166136261u;
+  for (unsigned i = 0; i < s.length(); i++) { h ^= (uint8_t)s[i]; h *= 16777619u; }
+  return h ? h : 1;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+#include <time.h>
+
+// =========================
+// CSE clock, CIN ct and key hashing
+// =========================
+// Small helpers shared by every module that orders or keys CINs.
+//
+// The CSE's clock is estimated from the Date header of Mobius responses:
+// the server time lies in [Date, Date + 1 s) and the response was produced
+// around the middle of the request, so each quick (< CSE_SKEW_MAX_RTT_MS)
+// response gives one sample
+//   skew = Date + 0.5 s - (send time + RTT / 2)
+// smoothed with an EWMA. Samples only count once NTP has set the clock.
+
+static const uint32_t CSE_SKEW_MAX_RTT_MS = 1000;
+
+// Date header of a Mobius response; sentAtMs is millis() when the request
+// went out, rttMs how long the answer took
+void cseClockSample(const String& date, unsigned long sentAtMs, uint32_t rttMs);
+
+// Estimated CSE clock minus device clock, 0 until the first sample
+int32_t cseSkewMs();
+uint32_t cseSkewSamples();
+
+// Current time in the CSE's clock (device clock + estimated skew), 0 before
+// NTP sync. Locally created commands are stamped with it, so they order
+// against cloud CINs by the CSE's ct.
+time_t cseNow();
+
+// cseNow() in CIN "ct" format, "" before NTP sync
+String ctNow();
+
+// CIN "ct" -> epoch seconds, 0 if too short
+uint32_t ctToEpoch(const String& ct);
+
+// FNV-1a of a CIN ri (or any key string), never 0 so callers can keep 0
+// for "none"
+uint32_t fnv1a(const String& s);
@@ -0,0 +1,95 @@
+#include "diagnostics.h"
+#include "flight_rec.h"
+#include "journal.h"
+#include "latency.h"
+#include "m2m_client.h"
+#include "net_ledger.h"
+#include "notify.h"
+#include "ota.h"
+#include <WiFi.h>
+#include <esp_system.h>
+
+enum : uint8_t { BAD_HEAP = 1, BAD_RSSI = 2, BAD_CSE = 4 };
+
+// Loop timing since the last snapshot
+static unsigned long lastTickMs = 0;
+static unsigned long maxPassMs = 0;
+static uint32_t stalls = 0, passes = 0;
+
+static unsigned long lastReportMs = 0;
+static unsigned long lastCheckMs = 0;
+static unsigned long intervalMs = DIAG_MIN_INTERVAL_MS;
+static const char* pending = "boot"; // anomaly waiting for a report
+static uint8_t badState = 0;
+static uint32_t lastFailures = 0, lastRejected = 0;
+
+void diagLoopTick() {
+  unsigned long now = millis();
+  if (lastTickMs) {
+    unsigned long pass = now - lastTickMs;
+    if (pass > maxPassMs) maxPassMs = pass;
+    if (pass >= DIAG_STALL_MS) stalls++;
+    if (pass >= DIAG_STALL_FLUSH_MS && !pending) pending = "stall";
+  }
+  passes++;
+  lastTickMs = now;
+}
+
+// Once a second; an anomaly is flagged on entering the bad state only
+static void checkAnomalies() {
+  frHeapCheck();
+  uint8_t bad = 0;
+  if (ESP.getFreeHeap() < DIAG_HEAP_LOW) bad |= BAD_HEAP;
+  if (WiFi.status() == WL_CONNECTED && WiFi.RSSI() < DIAG_RSSI_LOW) bad |= BAD_RSSI;
+  if (m2mCircuitOpen()) bad |= BAD_CSE;
+  uint8_t entered = bad & ~badState;
+  badState = bad;
+  if (!entered || pending) return;
+  pending = (entered & BAD_HEAP) ? "heap" : (entered & BAD_RSSI) ? "rssi" : "cse";
+}
+
+static String snapshot(const char* why) {
+  NotifyStats ns = notifyStats();
+  return String("{\"up\":") + String(millis() / 1000) +
+         ",\"why\":\"" + why + "\",\"rr\":" + String((int)esp_reset_reason()) +
+         ",\"hp\":[" + String(ESP.getFreeHeap()) + "," + String(ESP.getMinFreeHeap()) + "," +
+         String(ESP.getMaxAllocHeap()) + "],\"rs\":" + String(WiFi.RSSI()) +
+         ",\"lp\":[" + String(maxPassMs) + "," + String(stalls) + "," + String(passes) + "]" +
+         ",\"nt\":[" + String(ns.received) + "," + String(ns.applied) + "," + String(ns.dup) + "," +
+         String(ns.ignored) + "," + String(ns.stale) + "," + String(ns.rejected) + "," +
+         String(ns.deferred) + "]" +
+         ",\"jb\":" + String(journalBacklogBytes()) +
+         ",\"lat\":" + latencySummary() +
+         ",\"net\":" + netLedgerCompact() + "}";
+}
+
+void diagService() {
+  unsigned long now = millis();
+  if (now - lastCheckMs >= 1000) {
+    lastCheckMs = now;
+    checkAnomalies();
+  }
+  bool due = now - lastReportMs >= intervalMs;
+  bool early = pending && now - lastReportMs >= DIAG_ANOMALY_GAP_MS;
+  if ((!due && !early) || !tankCount) return;
+  if (anyPulseActive() || otaBusy()) return; // never delay a relay edge
+
+  const char* why = pending ? pending : "timer";
+  uint32_t failures = netLedgerFailures();
+  uint32_t rejected = notifyStats().rejected;
+  bool quiet = !pending && stalls == 0 && failures == lastFailures && rejected == lastRejected;
+  intervalMs = quiet ? min(intervalMs * 2, DIAG_MAX_INTERVAL_MS) : DIAG_MIN_INTERVAL_MS;
+
+  String con = snapshot(why);
+  bool stored = outboxPostCin(tanks[0], CNT_DIAG, con);
+  Serial.printf("[DIAG] %s snapshot (%u bytes)%s, next in %lus\n", why, con.length(),
+                stored ? "" : " lost", intervalMs / 1000);
+
+  pending = nullptr;
+  lastReportMs = millis();
+  lastFailures = failures;
+  lastRejected = rejected;
+  maxPassMs = 0;
+  stalls = passes = 0;
+  lastTickMs = millis(); // the post itself is not a loop stall
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <Arduino.h>
+
+// =========================
+// Diagnostics reporter (device -> Mobius)
+// =========================
+// A compact health snapshot is posted as one CIN to <first ae>/<CNT_DIAG>
+// through the journal outbox, so devices behind NAT report without a pull
+// endpoint and snapshots taken during an outage still arrive, in order:
+//   {"up":<s>,"why":"timer","rr":<reset reason>,
+//    "hp":[free,min free,largest block],"rs":<rssi dBm>,
+//    "lp":[max pass ms,stalls,passes],
+//    "nt":[received,applied,dup,ignored,stale,rejected,deferred],
+//    "jb":<journal backlog bytes>,"lat":[[notify n,avg ms],[poll n,avg ms],skew ms],
+//    "net":{<netLedgerCompact()>}}
+// Loop figures cover the time since the previous snapshot, everything else
+// is since boot (the server diffs, "up" shows a reboot).
+// "why" is "timer", "boot" or the anomaly that forced an early report:
+//   "stall" one loop pass took DIAG_STALL_FLUSH_MS or more
+//   "heap"  free heap fell below DIAG_HEAP_LOW
+//   "rssi"  signal fell below DIAG_RSSI_LOW
+//   "cse"   every Mobius endpoint is failing (reported when the outbox replays)
+// Anomalies report on the edge into the bad state, not while it persists.
+// After a quiet period (no stalls, request failures or rejected
+// notifications) the interval doubles up to DIAG_MAX_INTERVAL_MS; anything
+// notable brings it back to DIAG_MIN_INTERVAL_MS. Posting waits while a
+// pulse runs or an update streams, like the other reports.
+
+// First call of loop(): loop pass timing
+void diagLoopTick();
+
+// Call every loop
+void diagService();
@@ -0,0 +1,236 @@
+#include "energy.h"
+#include "notify.h"
+#include "lan_api.h"
+#include "journal.h"
+#include "cse_time.h"
+#include <time.h>
+
+struct Bucket {
+  uint32_t onMs;
+  uint32_t ws;      // watt-seconds
+  uint16_t cycles;  // off -> on
+};
+
+struct ChEnergy {
+  char cnt[24];           // channel the figures belong to (Channel::cnt)
+  bool on;
+  unsigned long sinceMs;  // start of the on-time not yet credited
+  uint16_t remWms;        // energy remainder below 1 Ws (watt-ms)
+  Bucket hour, day;       // current
+  Bucket hours[24];       // completed, ring
+  Bucket days[7];
+  Bucket sum24, sum7;     // rolling sums of the rings
+};
+
+struct TankEnergy {
+  ChEnergy ch[MAX_CH_PER_TANK];
+  uint8_t hHead, dHead;
+  uint8_t hourIdx, dayIdx; // ring slots of the hour/day to summarize
+  bool hourDue, dayDue;   // summary waiting to be posted
+  uint32_t hourStart, dayStart;
+};
+
+static TankEnergy* acc[MAX_TANKS];  // allocated for configured tanks only
+static uint32_t curHour = 0;        // epoch hour being accumulated (0 = no clock yet)
+static uint32_t curDay = 0;         // local date being accumulated, days since epoch
+static uint32_t curDayStart = 0;    // its local midnight, epoch s
+
+static void add(Bucket& b, uint32_t ms, uint32_t ws, uint16_t cycles) {
+  b.onMs += ms;
+  b.ws += ws;
+  b.cycles += cycles;
+}
+
+static void sub(Bucket& b, const Bucket& x) {
+  b.onMs -= x.onMs;
+  b.ws -= x.ws;
+  b.cycles -= x.cycles;
+}
+
+static void credit(ChEnergy& e, uint16_t watts, unsigned long now) {
+  if (!e.on) return;
+  uint32_t dt = now - e.sinceMs;
+  e.sinceMs = now;
+  uint64_t wms = (uint64_t)watts * dt + e.remWms;
+  e.remWms = wms % 1000;
+  add(e.hour, dt, (uint32_t)(wms / 1000), 0);
+  add(e.day, dt, (uint32_t)(wms / 1000), 0);
+}
+
+static void handleEnergy();
+
+void energyInit() {
+  server.on("/energy", HTTP_GET, handleEnergy);
+  for (uint8_t i = 0; i < tankCount; i++) {
+    acc[i] = (TankEnergy*)calloc(1, sizeof(TankEnergy));
+    if (!acc[i]) continue;
+    for (uint8_t k = 0; k < tanks[i].nch; k++) {
+      strlcpy(acc[i]->ch[k].cnt, tanks[i].ch[k].cnt, sizeof(acc[i]->ch[k].cnt));
+    }
+  }
+}
+
+void energyTransition(const Tank& t, uint8_t ch, bool on) {
+  TankEnergy* te = acc[&t - tanks];
+  if (!te) return;
+  ChEnergy& e = te->ch[ch];
+  unsigned long now = millis();
+  credit(e, t.ch[ch].watts, now);
+  if (on && !e.on) {
+    e.hour.cycles++;
+    e.day.cycles++;
+  }
+  e.on = on;
+  e.sinceMs = now;
+}
+
+void energySync(const Tank& t) {
+  TankEnergy* te = acc[&t - tanks];
+  if (!te) return;
+  unsigned long now = millis();
+  for (uint8_t k = 0; k < t.nch; k++) credit(te->ch[k], t.ch[k].watts, now);
+}
+
+void energyTableChanged(const Tank& t) {
+  TankEnergy* te = acc[&t - tanks];
+  if (!te) return;
+  // Figures follow the channel by cnt; a channel new to the table starts empty
+  ChEnergy* prev = (ChEnergy*)malloc(sizeof(te->ch));
+  if (prev) memcpy(prev, te->ch, sizeof(te->ch));
+  unsigned long now = millis();
+  for (uint8_t k = 0; k < MAX_CH_PER_TANK; k++) {
+    ChEnergy& e = te->ch[k];
+    e = ChEnergy{};
+    if (k >= t.nch) continue;
+    for (uint8_t j = 0; prev && j < MAX_CH_PER_TANK; j++) {
+      if (prev[j].cnt[0] && !strcmp(prev[j].cnt, t.ch[k].cnt)) { e = prev[j]; break; }
+    }
+    strlcpy(e.cnt, t.ch[k].cnt, sizeof(e.cnt));
+    e.on = t.ch[k].on;
+    e.sinceMs = now;
+  }
+  free(prev);
+}
+
+// =========================
+// Windows
+// =========================
+// Close the current hour (and day) and move the ring heads on by hours
+// (days) slots: the first one gets the closed bucket, the rest are hours the
+// clock skipped (NTP step, long stall) and stay empty.
+static void rollHours(const Tank& t, TankEnergy& te, uint8_t hours, uint8_t days, unsigned long now) {
+  for (uint8_t k = 0; k < MAX_CH_PER_TANK; k++) {
+    ChEnergy& e = te.ch[k];
+    if (k < t.nch) credit(e, t.ch[k].watts, now);
+    for (uint8_t n = 0; n < hours; n++) {
+      Bucket& slot = e.hours[(te.hHead + n) % 24];
+      sub(e.sum24, slot);
+      slot = n ? Bucket{} : e.hour;
+      add(e.sum24, slot.onMs, slot.ws, slot.cycles);
+    }
+    e.hour = Bucket{};
+    for (uint8_t n = 0; n < days; n++) {
+      Bucket& slot = e.days[(te.dHead + n) % 7];
+      sub(e.sum7, slot);
+      slot = n ? Bucket{} : e.day;
+      add(e.sum7, slot.onMs, slot.ws, slot.cycles);
+    }
+    if (days) e.day = Bucket{};
+  }
+  te.hourIdx = te.hHead;
+  te.hHead = (te.hHead + hours) % 24;
+  te.hourDue = true;
+  if (days) {
+    te.dayIdx = te.dHead;
+    te.dHead = (te.dHead + days) % 7;
+    te.dayDue = true;
+  }
+}
+
+// The hour (or day) closed by the last roll, for every channel
+static String summary(const Tank& t, bool day) {
+  const TankEnergy& te = *acc[&t - tanks];
+  String on, cy, wh;
+  for (uint8_t k = 0; k < t.nch; k++) {
+    const ChEnergy& e = te.ch[k];
+    const Bucket& b = day ? e.days[te.dayIdx] : e.hours[te.hourIdx];
+    if (k) { on += ","; cy += ","; wh += ","; }
+    on += String(b.onMs / 1000);
+    cy += String(b.cycles);
+    wh += String((b.ws + 1800) / 3600);
+  }
+  return String(day ? "{\"d\":" : "{\"h\":") + String(day ? te.dayStart : te.hourStart) +
+         ",\"on\":[" + on + "],\"cy\":[" + cy + "],\"wh\":[" + wh + "]}";
+}
+
+void energyService() {
+  time_t now = time(nullptr);
+  if (now < 1700000000) return;  // no wall clock yet, keep accumulating
+  uint32_t hour = (uint32_t)(now / 3600);
+  if (hour != curHour) {
+    struct tm lt;
+    localtime_r(&now, &lt);
+    char ymd[20];
+    strftime(ymd, sizeof(ymd), "%Y%m%dT000000", &lt);
+    uint32_t day = ctToEpoch(ymd) / 86400;
+    // A clock stepped back keeps accumulating into the current hour
+    if (curHour && hour > curHour) {
+      uint8_t hours = min(hour - curHour, (uint32_t)24);
+      uint8_t days = day > curDay ? min(day - curDay, (uint32_t)7) : 0;
+      for (uint8_t i = 0; i < tankCount; i++) {
+        if (!acc[i]) continue;
+        rollHours(tanks[i], *acc[i], hours, days, millis());
+        acc[i]->hourStart = curHour * 3600;
+        if (days) acc[i]->dayStart = curDayStart;
+      }
+    }
+    curHour = hour;
+    if (day != curDay) {
+      curDay = day;
+      curDayStart = (uint32_t)(now - lt.tm_hour * 3600 - lt.tm_min * 60 - lt.tm_sec);
+    }
+  }
+
+  // Summaries go out later, never in the same pass as a pulse
+  if (anyPulseActive()) return;
+  for (uint8_t i = 0; i < tankCount; i++) {
+    TankEnergy* te = acc[i];
+    if (!te) continue;
+    if (te->hourDue) {
+      te->hourDue = false;
+      outboxPostCin(tanks[i], CNT_ENERGY, summary(tanks[i], false));
+      return;
+    }
+    if (te->dayDue) {
+      te->dayDue = false;
+      outboxPostCin(tanks[i], CNT_ENERGY, summary(tanks[i], true));
+      return;
+    }
+  }
+}
+
+// =========================
+// Query endpoint
+// =========================
+static String triple(const Bucket& b) {
+  return "[" + String(b.onMs / 1000) + "," + String(b.cycles) + "," + String((b.ws + 1800) / 3600) + "]";
+}
+
+static void handleEnergy() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  Tank* t = server.hasArg("ae") ? findTank(server.arg("ae")) : (tankCount ? &tanks[0] : nullptr);
+  if (!t || !acc[t - tanks]) { server.send(404, "text/plain", "unknown ae"); return; }
+  energySync(*t);
+
+  TankEnergy& te = *acc[t - tanks];
+  String body = String("{\"ae\":\"") + t->ae + "\",\"ch\":[";
+  for (uint8_t k = 0; k < t->nch; k++) {
+    const ChEnergy& e = te.ch[k];
+    if (k) body += ",";
+    body += String("{\"cnt\":\"") + t->ch[k].cnt + "\",\"w\":" + String(t->ch[k].watts) +
+            ",\"hour\":" + triple(e.hour) + ",\"day\":" + triple(e.day) +
+            ",\"h24\":" + triple(e.sum24) + ",\"d7\":" + triple(e.sum7) + "}";
+  }
+  body += "],\"fmt\":\"[on s,cycles,Wh]\"}";
+  server.send(200, "application/json", body);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Per-channel on-time, cycles and energy
+// =========================
+// Incremental accumulators, updated at each relay transition and once at
+// every wall-clock hour boundary (O(1) per channel, no history scan):
+//   current hour, current day (local date), the last 24 completed hours
+//   and the last 7 completed days, with rolling sums over both rings.
+// Energy is on-time x Channel::watts, credited at the wattage in effect.
+// After each hour a compact summary CIN goes to <ae>/<CNT_ENERGY>
+// (through the outbox):
+//   {"h":<hour start epoch s>,"on":[s,...],"cy":[n,...],"wh":[Wh,...]}
+// and after each day the same with "d" instead of "h".
+//   GET /energy[?ae=]   current and rolling figures per channel (LAN token)
+// Hours (days) the clock skipped are entered as empty buckets, so the
+// rolling sums always cover the last 24 hours (7 days) of wall time.
+// Accumulators follow the channel by cnt when a remote config reorders the
+// table; a channel new to the table starts from zero.
+
+void energyInit();
+
+// Called by the relay layer on every level change
+void energyTransition(const Tank& t, uint8_t ch, bool on);
+
+// Credit running on-time now (before a wattage change)
+void energySync(const Tank& t);
+
+// Channel table of the tank replaced: pick up the new levels
+void energyTableChanged(const Tank& t);
+
+// Rolls buckets and posts summaries, call every loop
+void energyService();
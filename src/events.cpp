@@ -0,0 +1,175 @@
+#include "events.h"
+#include "notify.h"
+#include "lan_api.h"
+#include <lwip/sockets.h>
+#include <sys/time.h>
+
+struct Event {
+  uint32_t seq;
+  int64_t atMs;   // wall clock (epoch ms) of the edge
+  uint8_t tank;
+  uint8_t ch;
+  bool on;
+  CmdSource src;
+};
+
+struct SseClient {
+  WiFiClient sock;
+  bool used;
+  uint32_t next;            // seq of the next event to send
+  uint32_t lost;            // events skipped since the last frame
+  char out[192];            // current frame
+  uint16_t outLen, outOff;
+  unsigned long lastProgressMs;
+  unsigned long lastSendMs;
+};
+
+static Event ring[SSE_RING];
+static uint32_t headSeq = 1;  // seq the next published event gets
+static SseClient clients[SSE_MAX_CLIENTS];
+static EventStats stats;
+
+static uint32_t oldestSeq() {
+  return headSeq > SSE_RING ? headSeq - SSE_RING : 1;
+}
+
+void eventPublish(Tank& t, uint8_t ch, bool on, CmdSource src) {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  Event& e = ring[headSeq % SSE_RING];
+  e.seq = headSeq++;
+  e.atMs = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  e.tank = &t - tanks;
+  e.ch = ch;
+  e.on = on;
+  e.src = src;
+  stats.published++;
+}
+
+// =========================
+// Connection
+// =========================
+static void closeClient(SseClient& c) {
+  c.sock.stop();
+  c.sock = WiFiClient();
+  c.used = false;
+}
+
+static void handleEvents() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+
+  SseClient* slot = nullptr;
+  for (SseClient& c : clients) {
+    if (c.used && !c.sock.connected()) closeClient(c);
+    if (!c.used && !slot) slot = &c;
+  }
+  if (!slot) {
+    stats.rejected++;
+    server.send(503, "text/plain", "too many clients");
+    return;
+  }
+
+  // Resume after Last-Event-ID if the ring still has it, else live only
+  uint32_t next = headSeq;
+  if (server.hasHeader("Last-Event-ID")) {
+    uint32_t last = (uint32_t)server.header("Last-Event-ID").toInt();
+    if (last + 1 >= oldestSeq() && last < headSeq) next = last + 1;
+  }
+
+  // From here the slot owns the socket and the server takes new requests
+  slot->sock = takeClient();
+  if (slot->sock.fd() < 0) { slot->sock = WiFiClient(); return; }
+  slot->sock.setNoDelay(true);
+  // The response header is the slot's first frame, sent by pump() like the
+  // events: a client that reads nothing is evicted instead of blocking here
+  slot->outLen = snprintf(slot->out, sizeof(slot->out),
+                          "HTTP/1.1 200 OK\r\n"
+                          "Content-Type: text/event-stream\r\n"
+                          "Cache-Control: no-cache\r\n"
+                          "Connection: keep-alive\r\n\r\n"
+                          "retry: 3000\n\n");
+  slot->outOff = 0;
+  slot->used = true;
+  slot->next = next;
+  slot->lost = 0;
+  slot->lastProgressMs = slot->lastSendMs = millis();
+  Serial.printf("[SSE] client %s connected (from %u)\n",
+                slot->sock.remoteIP().toString().c_str(), next);
+}
+
+void eventsInit() {
+  server.on("/events", HTTP_GET, handleEvents);
+}
+
+// =========================
+// Pump
+// =========================
+// Next frame for a client, false if it is up to date
+static bool formatNext(SseClient& c) {
+  if (c.next >= headSeq) return false;
+  if (c.next < oldestSeq()) {
+    uint32_t skipped = oldestSeq() - c.next;
+    c.lost += skipped;
+    stats.lost += skipped;
+    c.next = oldestSeq();
+  }
+  const Event& e = ring[c.next % SSE_RING];
+  const Tank* t = e.tank < tankCount ? &tanks[e.tank] : nullptr;
+  const char* ch = (t && e.ch < t->nch) ? t->ch[e.ch].cnt : "?";
+  int n = snprintf(c.out, sizeof(c.out),
+                   "id: %lu\ndata: {\"ae\":\"%s\",\"ch\":\"%s\",\"on\":%d,\"src\":\"%s\",\"t\":%lld",
+                   (unsigned long)e.seq, t ? t->ae : "?", ch, e.on ? 1 : 0, srcTag(e.src),
+                   (long long)e.atMs);
+  if (c.lost) {
+    n += snprintf(c.out + n, sizeof(c.out) - n, ",\"lost\":%lu", (unsigned long)c.lost);
+    c.lost = 0;
+  }
+  n += snprintf(c.out + n, sizeof(c.out) - n, "}\n\n");
+  c.outLen = n;
+  c.outOff = 0;
+  c.next++;
+  return true;
+}
+
+// Sends what the socket takes right now. Returns false if the client is gone.
+static bool pump(SseClient& c, unsigned long now) {
+  while (true) {
+    if (c.outOff >= c.outLen) {
+      if (!formatNext(c)) {
+        if (now - c.lastSendMs < SSE_PING_MS) return true;
+        memcpy(c.out, ":\n\n", 3);   // comment line keeps proxies and NATs open
+        c.outLen = 3;
+        c.outOff = 0;
+      }
+    }
+    ssize_t w = send(c.sock.fd(), c.out + c.outOff, c.outLen - c.outOff, MSG_DONTWAIT);
+    if (w < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+      if (now - c.lastProgressMs < SSE_STALL_MS) return true;
+      stats.evicted++;
+      return false;
+    }
+    c.outOff += w;
+    c.lastProgressMs = c.lastSendMs = now;
+    if (c.outOff < c.outLen) return true;  // socket buffer full
+  }
+}
+
+void eventsService() {
+  unsigned long now = millis();
+  uint8_t n = 0;
+  for (SseClient& c : clients) {
+    if (!c.used) continue;
+    if (!c.sock.connected() || !pump(c, now)) {
+      Serial.println("[SSE] client closed");
+      closeClient(c);
+      continue;
+    }
+    n++;
+  }
+  stats.clients = n;
+}
+
+EventStats eventStats() {
+  return stats;
+}
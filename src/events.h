@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Server-Sent Events stream of relay state changes
+// =========================
+// GET /events on the notify server (LAN token as for /ch) keeps the
+// connection open and pushes one event per relay transition:
+//   id: <seq>
+//   data: {"ae":"AE-Actuator","ch":"LED","on":1,"src":"LAN","t":<epoch ms>}
+// Transitions go into one ring buffer shared by all clients; each client
+// only holds a read position and the unsent tail of its current frame.
+// Sockets are written with MSG_DONTWAIT, so a slow client falls behind
+// instead of blocking loop(). A client overrun by the ring skips ahead and
+// its next event carries "lost":<n>; a client that accepts nothing for
+// SSE_STALL_MS is disconnected. A reconnecting client may send
+// Last-Event-ID to resume while the ring still holds that event.
+
+static const uint8_t SSE_MAX_CLIENTS = 3;
+static const uint8_t SSE_RING = 64;
+static const unsigned long SSE_PING_MS  = 15UL * 1000UL;
+static const unsigned long SSE_STALL_MS = 10UL * 1000UL;
+
+void eventsInit();
+
+// Called by the relay layer on every level change (O(1), no I/O)
+void eventPublish(Tank& t, uint8_t ch, bool on, CmdSource src);
+
+// Push pending events to the clients, call every loop
+void eventsService();
+
+struct EventStats {
+  uint32_t published;
+  uint32_t lost;      // events skipped by overrun clients
+  uint32_t rejected;  // connections refused, all slots busy
+  uint32_t evicted;   // clients closed for stalling
+  uint8_t clients;
+};
+EventStats eventStats();
@@ -0,0 +1,87 @@
+#include "flight_rec.h"
+#include "journal.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+
+static const uint32_t FR_MAGIC = 0x31305246; // "FR01"
+
+RTC_NOINIT_ATTR FrRing frRing;
+
+// Tail of the previous boot's ring, kept until it is uploaded
+static FrEvent* crashEvents = nullptr;
+static uint8_t crashCount = 0;
+static uint8_t crashStage = 0;
+static int crashReason = 0;
+static uint32_t crashUpMs = 0;
+
+static uint32_t heapMinKb = UINT32_MAX;
+
+static const char* const stageNames[ST_COUNT] = {
+  "setup", "notify", "pulse", "poll", "events", "web", "lan", "subs",
+  "report", "tseries", "energy", "diag", "journal", "ota", "idle"
+};
+static const char* const kindNames[] = { "-", "req", "rsp", "notify", "relay", "heap" };
+
+// Resets that leave nothing to explain
+static bool cleanReset(esp_reset_reason_t r) {
+  return r == ESP_RST_POWERON || r == ESP_RST_SW || r == ESP_RST_DEEPSLEEP;
+}
+
+// i = 0 is the oldest event still in the ring
+static const FrEvent& at(uint16_t n, uint16_t i) {
+  return frRing.e[(frRing.head - n + i) & (FR_EVENTS - 1)];
+}
+
+void frInit() {
+  esp_reset_reason_t rr = esp_reset_reason();
+  bool valid = frRing.magic == FR_MAGIC && frRing.stage < ST_COUNT;
+  if (valid && frRing.head && !cleanReset(rr)) {
+    uint16_t n = frRing.head < FR_EVENTS ? frRing.head : FR_EVENTS;
+    Serial.printf("[FR] reset reason %d during %s, last %u events:\n",
+                  (int)rr, stageNames[frRing.stage], n);
+    for (uint16_t i = 0; i < n; i++) {
+      const FrEvent& e = at(n, i);
+      const char* kind = e.kind < sizeof(kindNames) / sizeof(kindNames[0]) ? kindNames[e.kind] : "?";
+      int b = e.kind == FR_RSP ? (int)(int16_t)e.b : (int)e.b;
+      Serial.printf("[FR] %9lu %-6s a=%u b=%d\n", (unsigned long)e.ms, kind, e.a, b);
+    }
+
+    crashCount = n < FR_UPLOAD_EVENTS ? n : FR_UPLOAD_EVENTS;
+    crashEvents = (FrEvent*)malloc(crashCount * sizeof(FrEvent));
+    if (crashEvents) {
+      for (uint8_t i = 0; i < crashCount; i++) crashEvents[i] = at(n, n - crashCount + i);
+    }
+    crashStage = frRing.stage;
+    crashReason = (int)rr;
+    crashUpMs = at(n, n - 1).ms;
+  }
+  memset(&frRing, 0, sizeof(frRing));
+  frRing.magic = FR_MAGIC;
+  frRing.stage = ST_SETUP;
+}
+
+void frHeapCheck() {
+  uint32_t kb = ESP.getMinFreeHeap() / 1024;
+  if (kb >= heapMinKb) return;
+  heapMinKb = kb;
+  frNote(FR_HEAP, 0, kb);
+}
+
+void frUpload() {
+  if (!crashEvents || !tankCount) return;
+  static const char hex[] = "0123456789abcdef";
+  String ev;
+  ev.reserve(crashCount * sizeof(FrEvent) * 2);
+  const uint8_t* p = (const uint8_t*)crashEvents;
+  for (size_t i = 0; i < crashCount * sizeof(FrEvent); i++) {
+    ev += hex[p[i] >> 4];
+    ev += hex[p[i] & 0x0F];
+  }
+  String con = String("{\"why\":\"crash\",\"rr\":") + String(crashReason) +
+               ",\"stage\":\"" + stageNames[crashStage] + "\",\"up\":" + String(crashUpMs) +
+               ",\"ev\":\"" + ev + "\"}";
+  bool stored = outboxPostCin(tanks[0], CNT_DIAG, con);
+  Serial.printf("[FR] crash record (%u events)%s\n", crashCount, stored ? " posted" : " lost");
+  free(crashEvents);
+  crashEvents = nullptr;
+}
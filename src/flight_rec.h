@@ -0,0 +1,72 @@
+#pragma once
+#include <Arduino.h>
+
+// =========================
+// Flight recorder (RTC slow memory)
+// =========================
+// A ring of the last FR_EVENTS events plus the loop stage in progress, kept
+// in RTC_NOINIT memory so it survives panics, watchdog and brownout resets
+// (it is lost only on power-on). Each event is 8 bytes, little-endian:
+//   ms since boot u32 | kind u8 | a u8 | b u16
+//   FR_REQ    Mobius request started   a = NetOp, b = endpoint index
+//   FR_RSP    Mobius request finished  a = NetOp, b = HTTP code (int16)
+//   FR_NOTIFY notification received    a = tank index (0xFF unknown)
+//   FR_RELAY  relay level changed      a = tank << 4 | channel, b = on
+//   FR_HEAP   new free-heap minimum    b = KB
+// Recording is an inline store, cheap enough to stay on in production.
+//
+// At boot, a ring left by a reset other than power-on, software restart or
+// deep sleep is dumped to the log, and its last FR_UPLOAD_EVENTS events are
+// posted once to <first ae>/<CNT_DIAG> through the outbox:
+//   {"why":"crash","rr":<reset reason>,"stage":"<stage>","up":<ms>,
+//    "ev":"<hex of the 8-byte events, oldest first>"}
+
+static const uint16_t FR_EVENTS = 128;        // power of two
+static const uint8_t FR_UPLOAD_EVENTS = 56;
+
+enum FrKind : uint8_t { FR_NONE, FR_REQ, FR_RSP, FR_NOTIFY, FR_RELAY, FR_HEAP };
+
+// loop() step in progress
+enum FrStage : uint8_t {
+  ST_SETUP, ST_NOTIFY, ST_PULSE, ST_POLL, ST_EVENTS, ST_WEB, ST_LAN, ST_SUBS,
+  ST_REPORT, ST_TSERIES, ST_ENERGY, ST_DIAG, ST_JOURNAL, ST_OTA, ST_IDLE,
+  ST_COUNT
+};
+
+struct FrEvent {
+  uint32_t ms;
+  uint8_t kind;
+  uint8_t a;
+  uint16_t b;
+};
+
+struct FrRing {
+  uint32_t magic;
+  uint32_t head;         // events written this boot (index = head % FR_EVENTS)
+  uint8_t stage;
+  FrEvent e[FR_EVENTS];
+};
+
+extern FrRing frRing;
+
+inline void frNote(uint8_t kind, uint8_t a, uint16_t b) {
+  FrEvent& e = frRing.e[frRing.head & (FR_EVENTS - 1)];
+  e.ms = millis();
+  e.kind = kind;
+  e.a = a;
+  e.b = b;
+  frRing.head++;
+}
+
+inline void frStage(FrStage s) {
+  frRing.stage = s;
+}
+
+// First thing in setup(): dump a crash ring, then start a fresh one
+void frInit();
+
+// Records a new free-heap minimum (call periodically)
+void frHeapCheck();
+
+// Posts the crash ring once Mobius is set up (end of setup)
+void frUpload();
@@ -0,0 +1,121 @@
+#include "history.h"
+#include "notify.h"
+#include "lan_api.h"
+#include "cse_time.h"
+#include <sys/time.h>
+
+struct HistEntry {
+  uint32_t atSec;    // apply time, epoch seconds (uptime seconds before NTP)
+  uint16_t atMs;
+  uint8_t srcRes;    // source << 4 | result
+  uint8_t repeats;
+  uint32_t riHash;   // FNV-1a of ri, 0 if none
+  uint32_t ctSec;    // CIN ct as epoch seconds, 0 if none
+};
+
+struct HistRing {
+  char cnt[24];      // channel the ring belongs to ("" until first use)
+  HistEntry e[HIST_PER_CH];
+  uint8_t head;      // next slot
+  uint8_t count;
+};
+
+static HistRing rings[MAX_TANKS][MAX_CH_PER_TANK];
+
+static HistEntry& at(HistRing& r, uint8_t i) {
+  // i = 0 is the oldest entry
+  return r.e[(r.head + HIST_PER_CH - r.count + i) % HIST_PER_CH];
+}
+
+void historyAppend(const Tank& t, const Channel& c, const Command& cmd, CmdResult res) {
+  HistRing& r = rings[&t - tanks][&c - t.ch];
+  if (!r.cnt[0]) strlcpy(r.cnt, c.cnt, sizeof(r.cnt));
+  uint8_t srcRes = (uint8_t)(cmd.src << 4 | res);
+  uint32_t ri = cmd.ri.length() ? fnv1a(cmd.ri) : 0;
+
+  if (ri && r.count) {
+    HistEntry& last = at(r, r.count - 1);
+    if (last.riHash == ri && last.srcRes == srcRes) {
+      if (last.repeats < 255) last.repeats++;
+      return;
+    }
+  }
+
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  HistEntry& e = r.e[r.head];
+  e.atSec = (uint32_t)tv.tv_sec;
+  e.atMs = tv.tv_usec / 1000;
+  e.srcRes = srcRes;
+  e.repeats = 0;
+  e.riHash = ri;
+  e.ctSec = ctToEpoch(cmd.ct);
+  r.head = (r.head + 1) % HIST_PER_CH;
+  if (r.count < HIST_PER_CH) r.count++;
+}
+
+void historyTableChanged(const Tank& t) {
+  HistRing* row = rings[&t - tanks];
+  // History follows the channel by cnt; a channel new to the table starts empty
+  HistRing* prev = (HistRing*)malloc(sizeof(rings[0]));
+  if (prev) memcpy(prev, row, sizeof(rings[0]));
+  for (uint8_t k = 0; k < MAX_CH_PER_TANK; k++) {
+    HistRing& r = row[k];
+    r = HistRing{};
+    if (k >= t.nch) continue;
+    for (uint8_t j = 0; prev && j < MAX_CH_PER_TANK; j++) {
+      if (prev[j].cnt[0] && !strcmp(prev[j].cnt, t.ch[k].cnt)) { r = prev[j]; break; }
+    }
+    strlcpy(r.cnt, t.ch[k].cnt, sizeof(r.cnt));
+  }
+  free(prev);
+}
+
+// First entry with atSec >= sec
+static uint8_t lowerBound(HistRing& r, uint32_t sec) {
+  uint8_t lo = 0, hi = r.count;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (at(r, mid).atSec < sec) lo = mid + 1; else hi = mid;
+  }
+  return lo;
+}
+
+// =========================
+// Query endpoint
+// =========================
+static void handleHistory() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  Tank* t = findTank(server.arg("ae"));
+  if (!t && !server.hasArg("ae") && tankCount) t = &tanks[0];
+  if (!t) { server.send(404, "text/plain", "unknown ae"); return; }
+  Channel* c = findChannel(*t, server.arg("ch"));
+  if (!c) { server.send(404, "text/plain", "unknown channel"); return; }
+
+  HistRing& r = rings[t - tanks][c - t->ch];
+  uint32_t from = server.hasArg("from") ? (uint32_t)server.arg("from").toInt() : 0;
+  uint32_t to = server.hasArg("to") ? (uint32_t)server.arg("to").toInt() : 0xFFFFFFFFu;
+  long want = server.hasArg("n") ? server.arg("n").toInt() : HIST_PER_CH;
+  uint8_t n = want < 1 ? 1 : (want > HIST_PER_CH ? HIST_PER_CH : (uint8_t)want);
+  static const char* const results[] = { "ok", "dup", "ignored", "stale" };
+
+  String body = String("{\"ch\":\"") + c->cnt + "\",\"h\":[";
+  uint8_t sent = 0;
+  for (uint8_t i = lowerBound(r, from); i < r.count && sent < n; i++) {
+    const HistEntry& e = at(r, i);
+    if (e.atSec > to) break;
+    char row[96];
+    snprintf(row, sizeof(row), "%s[%lu,%u,\"%s\",\"%s\",\"%08lx\",%lu,%u]", sent ? "," : "",
+             (unsigned long)e.atSec, e.atMs, srcTag((CmdSource)(e.srcRes >> 4)),
+             results[(e.srcRes & 0x0F) & 3], (unsigned long)e.riHash,
+             (unsigned long)e.ctSec, e.repeats);
+    body += row;
+    sent++;
+  }
+  body += "]}";
+  server.send(200, "application/json", body);
+}
+
+void historyInit() {
+  server.on("/history", HTTP_GET, handleHistory);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Per-channel command history (RAM ring)
+// =========================
+// Every command that reaches a channel (applied, duplicate, ignored or
+// stale) is recorded in a fixed ring of HIST_PER_CH entries:
+//   apply time (epoch s + ms), source, result, hash of the CIN ri, CIN ct
+// Appends are O(1) with no allocation and no I/O. A re-delivery of the
+// last recorded CIN (same ri and result, e.g. every poll of an unchanged
+// container) only bumps that entry's repeat counter.
+// Apply times only grow, so a time range is found by binary search.
+// Rings belong to the channel's cnt, not its position in the table.
+//
+//   GET /history?ae=<ae>&ch=<cnt>[&from=<epoch s>][&to=<epoch s>][&n=<max>]
+//   -> {"ch":..,"h":[[t,ms,"SRC","result","rihash",ct,repeats],...]}
+// (LAN token required; ct is epoch seconds, 0 if the CIN had none)
+
+static const uint8_t HIST_PER_CH = 24;
+
+void historyInit();
+
+// Called by the relay layer for every command that reached a channel
+void historyAppend(const Tank& t, const Channel& c, const Command& cmd, CmdResult r);
+
+// The tank's channel table was replaced (remote config): rings move with
+// their channel's cnt, a new channel starts empty
+void historyTableChanged(const Tank& t);
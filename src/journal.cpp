@@ -0,0 +1,289 @@
+#include "journal.h"
+#include "m2m_client.h"
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+
+static const char* const JRNL_DIR    = "/jrnl";
+static const char* const JRNL_CURSOR = "/jrnl/cursor";
+static const uint8_t JRNL_MAGIC = 0xA5;
+static const size_t JRNL_HDR = 7;             // magic + len + crc
+static const size_t JRNL_MAX_RECORD = 1280;   // header + payload
+
+static uint32_t tailSeg = 0, headSeg = 0;     // oldest / newest segment number
+static uint32_t readOff = 0;                  // replay position in tailSeg
+static uint32_t headSize = 0;                 // bytes of headSeg on flash
+static uint32_t flashBacklog = 0;             // unreplayed bytes on flash
+static uint32_t droppedBytes = 0;
+
+static uint8_t wbuf[JOURNAL_WBUF_BYTES];
+static size_t wlen = 0;
+static unsigned long wbufSinceMs = 0;
+
+static uint8_t rec[JRNL_MAX_RECORD];
+static uint32_t bootTag = 0;
+static uint32_t seq = 0;
+static uint8_t unsaved = 0;                   // records replayed since the last cursor write
+
+static String segPath(uint32_t n) {
+  return String(JRNL_DIR) + "/" + String(n) + ".log";
+}
+
+static bool journalEmpty() {
+  return flashBacklog == 0 && wlen == 0;
+}
+
+uint32_t journalBacklogBytes() {
+  return flashBacklog + wlen;
+}
+
+// =========================
+// Cursor
+// =========================
+static void saveCursor() {
+  File f = LittleFS.open(JRNL_CURSOR, "w");
+  if (!f) return;
+  uint32_t v[2] = { tailSeg, readOff };
+  f.write((const uint8_t*)v, sizeof(v));
+  f.close();
+}
+
+void journalInit() {
+  bootTag = esp_random();
+  if (!LittleFS.exists(JRNL_DIR)) LittleFS.mkdir(JRNL_DIR);
+
+  // Find the segment range on flash
+  bool any = false;
+  uint32_t lo = 0, hi = 0;
+  File dir = LittleFS.open(JRNL_DIR);
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    String name = f.name();
+    name = name.substring(name.lastIndexOf('/') + 1);
+    if (!name.endsWith(".log")) continue;
+    uint32_t n = (uint32_t)name.toInt();
+    if (!any || n < lo) lo = n;
+    if (!any || n > hi) hi = n;
+    any = true;
+  }
+
+  uint32_t cur[2] = { 0, 0 };
+  File cf = LittleFS.open(JRNL_CURSOR, "r");
+  if (cf) { cf.read((uint8_t*)cur, sizeof(cur)); cf.close(); }
+
+  if (!any) {
+    tailSeg = headSeg = cur[0];
+    readOff = headSize = flashBacklog = 0;
+  } else {
+    tailSeg = lo; headSeg = hi;
+    readOff = (cur[0] == lo) ? cur[1] : 0;
+    flashBacklog = 0;
+    for (uint32_t n = lo; n <= hi; n++) {
+      File f = LittleFS.open(segPath(n), "r");
+      if (!f) continue;
+      uint32_t sz = f.size();
+      f.close();
+      if (n == hi) headSize = sz;
+      flashBacklog += (n == lo) ? (sz > readOff ? sz - readOff : 0) : sz;
+    }
+    // New records go to a fresh segment, so a record torn by the reset
+    // cannot hide anything appended after it
+    if (headSize > 0) { headSeg++; headSize = 0; }
+  }
+  Serial.printf("[JRNL] segments %u..%u, backlog %u bytes\n", tailSeg, headSeg, flashBacklog);
+}
+
+// =========================
+// Append
+// =========================
+static void flushWbuf() {
+  if (!wlen) return;
+  File f = LittleFS.open(segPath(headSeg), "a");
+  if (!f) { Serial.println("[JRNL] open for append failed"); return; }
+  size_t w = f.write(wbuf, wlen);
+  f.close();
+  headSize += w;
+  flashBacklog += w;
+  wlen = 0;
+}
+
+static void dropTailSegment() {
+  File f = LittleFS.open(segPath(tailSeg), "r");
+  uint32_t sz = f ? f.size() : 0;
+  if (f) f.close();
+  uint32_t lost = sz > readOff ? sz - readOff : 0;
+  LittleFS.remove(segPath(tailSeg));
+  flashBacklog -= min(flashBacklog, lost);
+  droppedBytes += lost;
+  tailSeg++;
+  readOff = 0;
+  saveCursor();
+  Serial.printf("[JRNL] full, dropped %u bytes (total %u)\n", lost, droppedBytes);
+}
+
+static bool journalAppend(const char* rn, const char* ae, const char* cnt, const String& con) {
+  size_t lrn = strlen(rn), lae = strlen(ae), lcnt = strlen(cnt);
+  size_t plen = lrn + 1 + lae + 1 + lcnt + 1 + con.length();
+  size_t total = JRNL_HDR + plen;
+  if (total > JRNL_MAX_RECORD) { Serial.printf("[JRNL] record too large (%u)\n", total); return false; }
+
+  uint8_t* p = rec + JRNL_HDR;
+  memcpy(p, rn, lrn + 1);  p += lrn + 1;
+  memcpy(p, ae, lae + 1);  p += lae + 1;
+  memcpy(p, cnt, lcnt + 1); p += lcnt + 1;
+  memcpy(p, con.c_str(), con.length());
+  uint32_t crc = esp_rom_crc32_le(0, rec + JRNL_HDR, plen);
+  rec[0] = JRNL_MAGIC;
+  rec[1] = plen & 0xFF; rec[2] = plen >> 8;
+  memcpy(rec + 3, &crc, 4);
+
+  // Segment rotation keeps the journal bounded
+  if (headSize + wlen + total > JOURNAL_SEG_BYTES) {
+    flushWbuf();
+    if (headSize > 0) {
+      headSeg++;
+      headSize = 0;
+      if (headSeg - tailSeg >= JOURNAL_MAX_SEGS) dropTailSegment();
+    }
+  }
+
+  if (wlen + total > sizeof(wbuf)) flushWbuf();
+  if (total > sizeof(wbuf)) {
+    // Larger than the batch buffer: straight to flash
+    File f = LittleFS.open(segPath(headSeg), "a");
+    if (!f) return false;
+    size_t w = f.write(rec, total);
+    f.close();
+    headSize += w;
+    flashBacklog += w;
+    return w == total;
+  }
+  if (!wlen) wbufSinceMs = millis();
+  memcpy(wbuf + wlen, rec, total);
+  wlen += total;
+  return true;
+}
+
+// =========================
+// Outbox
+// =========================
+static String cinBody(const char* rn, const String& con) {
+  return String("{\"m2m:cin\":{\"rn\":\"") + rn + "\",\"con\":" + con + "}}";
+}
+
+// 201 created, 409 already there (replay of a delivered record)
+static bool delivered(int code) { return code == 201 || code == 409; }
+
+// 4xx other than timeouts/throttling will not succeed on replay either
+static bool rejected(int code) { return code >= 400 && code < 500 && code != 408 && code != 429; }
+
+bool outboxPostCin(Tank& t, const char* cnt, const String& con) {
+  char rn[24];
+  snprintf(rn, sizeof(rn), "j%08lx-%lu", (unsigned long)bootTag, (unsigned long)++seq);
+
+  // Direct post only if it cannot overtake queued records
+  if (journalEmpty() && !m2mCircuitOpen()) {
+    String resp;
+    int code = m2mPost(t, cntPath(t, cnt), 4, cinBody(rn, con), resp, rn);
+    if (delivered(code)) return true;
+    if (rejected(code)) {
+      Serial.printf("[OUTBOX][%s/%s] rejected HTTP %d, not stored\n", t.ae, cnt, code);
+      return true;
+    }
+  }
+  return journalAppend(rn, t.ae, cnt, con);
+}
+
+// =========================
+// Replay
+// =========================
+// Reads the record at (tailSeg, readOff). Returns its size, 0 at the end of
+// the data or on a torn/corrupt record.
+static size_t readRecord(File& f, String& rn, String& ae, String& cnt, String& con) {
+  if (!f.seek(readOff)) return 0;
+  if (f.read(rec, JRNL_HDR) != JRNL_HDR || rec[0] != JRNL_MAGIC) return 0;
+  size_t plen = rec[1] | (rec[2] << 8);
+  uint32_t crc;
+  memcpy(&crc, rec + 3, 4);
+  if (JRNL_HDR + plen > sizeof(rec)) return 0;
+  if (f.read(rec + JRNL_HDR, plen) != plen) return 0;
+  if (esp_rom_crc32_le(0, rec + JRNL_HDR, plen) != crc) return 0;
+
+  const char* p = (const char*)rec + JRNL_HDR;
+  const char* end = p + plen;
+  rn = p;  p += rn.length() + 1;  if (p > end) return 0;
+  ae = p;  p += ae.length() + 1;  if (p > end) return 0;
+  cnt = p; p += cnt.length() + 1; if (p > end) return 0;
+  con = "";
+  con.concat(p, end - p);
+  return JRNL_HDR + plen;
+}
+
+// Moves past a finished tail segment. Returns false if the tail is the head.
+static bool advanceSegment() {
+  if (tailSeg == headSeg) {
+    if (readOff >= headSize && wlen == 0 && headSize > 0) {
+      // Fully replayed: start a fresh file instead of growing this one
+      LittleFS.remove(segPath(tailSeg));
+      tailSeg = ++headSeg;
+      readOff = headSize = 0;
+      flashBacklog = 0;
+    }
+    return false;
+  }
+  LittleFS.remove(segPath(tailSeg));
+  tailSeg++;
+  readOff = 0;
+  return true;
+}
+
+void journalService() {
+  // Keep the RAM batch bounded in time as well
+  if (wlen && millis() - wbufSinceMs >= JOURNAL_FLUSH_MS) flushWbuf();
+
+  if (journalEmpty() || m2mCircuitOpen() || anyPulseActive()) return;
+  flushWbuf();
+
+  // One post per pass: a blocking TLS POST per record, so a long backlog
+  // must not starve the server; loop() does the pacing
+  bool moved = false;
+  for (;;) {
+    File f = LittleFS.open(segPath(tailSeg), "r");
+    uint32_t segSize = 0;
+    size_t sz = 0;
+    String rn, ae, cnt, con;
+    if (f) {
+      segSize = f.size();
+      sz = readRecord(f, rn, ae, cnt, con);
+      f.close();
+    }
+    if (!sz) {
+      // End of segment, or a torn record: the rest of this segment is unusable
+      if (segSize > readOff) {
+        Serial.printf("[JRNL] corrupt record at %u:%u, skipping %u bytes\n",
+                      tailSeg, readOff, segSize - readOff);
+        flashBacklog -= min(flashBacklog, segSize - readOff);
+        readOff = segSize;
+        moved = true;
+      }
+      if (!advanceSegment()) break;
+      moved = true;
+      continue;
+    }
+
+    Tank* t = findTank(ae);
+    int code = 0;
+    if (t) {
+      String resp;
+      code = m2mPost(*t, cntPath(*t, cnt.c_str()), 4, cinBody(rn.c_str(), con), resp, rn.c_str());
+      if (!delivered(code) && !rejected(code)) break; // retry later from the same record
+    }
+    Serial.printf("[JRNL] replay %s %s/%s -> %d\n", rn.c_str(), ae.c_str(), cnt.c_str(), code);
+    readOff += sz;
+    flashBacklog -= min(flashBacklog, (uint32_t)sz);
+    unsaved++;
+    break;
+  }
+  if (moved || (unsaved && (unsaved >= JOURNAL_DRAIN_BATCH || journalEmpty()))) {
+    saveCursor();
+    unsaved = 0;
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Store-and-forward journal (LittleFS)
+// =========================
+// Outbound CINs (state reports, diagnostics, ...) go through the outbox.
+// While Mobius is reachable and nothing is queued they are posted directly;
+// otherwise they are appended to an on-flash journal and replayed in order
+// once the circuit breaker closes again.
+//
+// Layout: /jrnl/<n>.log segments of at most JOURNAL_SEG_BYTES, at most
+// JOURNAL_MAX_SEGS of them (the oldest is dropped when full), and /jrnl/cursor
+// with the replay position. Each record is
+//   [0xA5][len u16][crc32 u32][payload]
+//   payload = rn \0 ae \0 cnt \0 con
+// Records are collected in a RAM buffer and appended in one write. Replay
+// posts one record per loop pass so the server keeps being served, and the
+// cursor is rewritten every JOURNAL_DRAIN_BATCH records, not per record (a
+// reset replays at most that many again, which the 409 below absorbs).
+//
+// Every record carries a unique rn (boot tag + sequence) that is used as the
+// CIN resource name and X-M2M-RI. A replay of a CIN that already reached the
+// server gets 409 and counts as delivered, so replay is idempotent.
+
+void journalInit();
+
+// con is a JSON value (object or quoted string). Returns false only when the
+// record could neither be posted nor stored.
+bool outboxPostCin(Tank& t, const char* cnt, const String& con);
+
+// Replays stored records while Mobius is reachable, call every loop
+void journalService();
+
+// Bytes waiting for replay (flash + RAM buffer)
+uint32_t journalBacklogBytes();
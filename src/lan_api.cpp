@@ -0,0 +1,137 @@
+#include "lan_api.h"
+#include "notify.h"
+#include "m2m_client.h"
+#include "cse_time.h"
+#include <ArduinoJson.h>
+#include <uri/UriBraces.h>
+#include <mbedtls/md.h>
+
+static uint32_t mirrorMask[MAX_TANKS]; // level channels with an unmirrored LAN change
+
+// ri of the last mirrors posted, so their notifications are not applied
+static const uint8_t MIRROR_RIS = 8;
+static String mirrorRis[MIRROR_RIS];
+static uint8_t mirrorRiNext = 0;
+
+static void tokenDigest(const String& v, uint8_t* out) {
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                  (const uint8_t*)LAN_API_TOKEN, strlen(LAN_API_TOKEN),
+                  (const uint8_t*)v.c_str(), v.length(), out);
+}
+
+// Fixed-length digests compared in constant time, so neither the token's
+// content nor its length leaks through timing
+bool lanAuthorized() {
+  if (!*LAN_API_TOKEN) return false;
+  // ?token= only for browser EventSource, which cannot set headers; anywhere
+  // else it would end up in logs and history
+  String auth = server.uri() == "/events" && server.hasArg("token")
+                    ? String("Bearer ") + server.arg("token")
+                    : server.header("Authorization");
+  uint8_t got[32], want[32];
+  tokenDigest(auth, got);
+  tokenDigest(String("Bearer ") + LAN_API_TOKEN, want);
+  uint8_t diff = 0;
+  for (size_t i = 0; i < sizeof(want); i++) diff |= got[i] ^ want[i];
+  return diff == 0;
+}
+
+static Channel* findByName(Tank& t, const String& name) {
+  Channel* c = findChannel(t, name);
+  if (c) return c;
+  for (uint8_t k = 0; k < t.nch; k++) {
+    if (name.equalsIgnoreCase(t.ch[k].name)) return &t.ch[k];
+  }
+  return nullptr;
+}
+
+static void sendState(const Tank& t, const Channel& c, const char* result) {
+  String body = String("{\"ae\":\"") + t.ae + "\",\"ch\":\"" + c.cnt + "\",\"on\":" +
+                (c.on ? "true" : "false") + ",\"result\":\"" + result + "\"}";
+  server.send(200, "application/json", body);
+}
+
+static void handleChannel(Tank* t, const String& name) {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  if (!t) { server.send(404, "text/plain", "unknown ae"); return; }
+  Channel* c = findByName(*t, name);
+  if (!c) { server.send(404, "text/plain", "unknown channel"); return; }
+
+  if (server.method() == HTTP_GET) { sendState(*t, *c, "ok"); return; }
+  if (server.method() != HTTP_PUT && server.method() != HTTP_POST) {
+    server.send(405, "text/plain", "method");
+    return;
+  }
+
+  String body = server.arg("plain");
+  body.trim();
+  bool on = false;
+  if (!parseConToOnOff(body, on)) { server.send(400, "text/plain", "bad value"); return; }
+
+  CmdResult r = applyCommand(*t, *c, Command{on, SRC_LAN, "", ctNow()});
+  if (r == CMD_APPLIED) lanMirror(*t, 1UL << (c - t->ch));
+
+  static const char* const names[] = { "ok", "dup", "ignored", "stale" };
+  sendState(*t, *c, names[r]);
+}
+
+static void handleDefaultTank() {
+  handleChannel(tankCount ? &tanks[0] : nullptr, server.pathArg(0));
+}
+
+static void handleTankChannel() {
+  handleChannel(findTank(server.pathArg(0)), server.pathArg(1));
+}
+
+void lanMirror(Tank& t, uint32_t mask) {
+  for (uint8_t k = 0; k < t.nch; k++) {
+    if ((mask & (1UL << k)) && t.ch[k].kind == CH_LEVEL) mirrorMask[&t - tanks] |= 1UL << k;
+  }
+}
+
+void lanApiInit() {
+  server.on(UriBraces("/ch/{}/{}"), HTTP_ANY, handleTankChannel);
+  server.on(UriBraces("/ch/{}"),    HTTP_ANY, handleDefaultTank);
+}
+
+bool lanIsMirrorEcho(const String& ri) {
+  if (!ri.length()) return false;
+  for (uint8_t i = 0; i < MIRROR_RIS; i++) if (mirrorRis[i] == ri) return true;
+  return false;
+}
+
+void lanService() {
+  // A slow Mobius post must not delay a pulse edge
+  if (anyPulseActive()) return;
+  for (uint8_t i = 0; i < tankCount; i++) {
+    if (!mirrorMask[i]) continue;
+    Tank& t = tanks[i];
+    uint8_t k = __builtin_ctz(mirrorMask[i]);
+    mirrorMask[i] &= ~(1UL << k);
+    if (k >= t.nch) return;
+    Channel& c = t.ch[k];
+    // Not journaled: a replay would get a fresh ct from the CSE and override
+    // whatever the cloud sent in the meantime. The level is read now, so
+    // only the latest state goes out, and it is dropped if Mobius is down.
+    if (m2mCircuitOpen()) {
+      Serial.printf("[LAN][%s/%s] Mobius unreachable, mirror dropped\n", t.ae, c.name);
+      return;
+    }
+    String resp;
+    int code = m2mPost(t, cntPath(t, c.cnt), 4,
+                       String("{\"m2m:cin\":{\"con\":\"") + (c.on ? "on" : "off") + "\"}}", resp);
+    if (code != 201) {
+      Serial.printf("[LAN][%s/%s] mirror failed (HTTP %d), dropped\n", t.ae, c.name, code);
+      return;
+    }
+    StaticJsonDocument<1024> doc;
+    const char* ri = deserializeJson(doc, resp) ? nullptr : doc["m2m:cin"]["ri"].as<const char*>();
+    if (!ri) {
+      Serial.printf("[LAN][%s/%s] mirror posted, no ri in the response\n", t.ae, c.name);
+      return;
+    }
+    mirrorRis[mirrorRiNext] = ri;
+    mirrorRiNext = (mirrorRiNext + 1) % MIRROR_RIS;
+    return; // one post per pass
+  }
+}
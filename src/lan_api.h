@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Direct LAN control (no cloud round trip)
+// =========================
+// On the notify server (NOTIFY_PORT):
+//   PUT /ch/<channel>        first AE
+//   PUT /ch/<ae>/<channel>   any AE
+//     body "on" / "off" / 1 / 0 / true / false (same forms as a CIN con)
+//   GET on the same paths returns {"ae":..,"ch":..,"on":..}
+// <channel> is the container or the channel name. Requests need
+// "Authorization: Bearer <LAN_API_TOKEN>" (/events also takes ?token=).
+// Commands take the same path as notifications (applyCommand) with ct set
+// to the current time in the CSE's clock (ctNow(), skew-corrected), so an
+// older cloud CIN seen later by the poller is stale but a newer one is not.
+// Level changes are then mirrored to the channel container on Mobius from
+// loop(), so the cloud does not switch the relay back after a reboot. A
+// mirror carries the level at send time, is never journaled (a late replay
+// would override newer cloud commands) and is dropped while Mobius is
+// unreachable. Its echo is recognised by ri and not applied again. Pulse
+// channels are not mirrored (the echoed CIN would fire again); their edges
+// still reach <ae>/state.
+
+void lanApiInit();
+
+// Request on the notify server carries the LAN token (header, or ?token=
+// on /events)
+bool lanAuthorized();
+
+// Queue a mirror of these channels' current level (level channels only)
+void lanMirror(Tank& t, uint32_t mask);
+
+// Posts pending mirrors, call every loop
+void lanService();
+
+// ri is a CIN this device posted as a mirror (its notification/poll echo)
+bool lanIsMirrorEcho(const String& ri);
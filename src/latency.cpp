@@ -0,0 +1,127 @@
+#include "latency.h"
+#include "notify.h"
+#include "lan_api.h"
+#include "cse_time.h"
+#include <sys/time.h>
+
+enum : uint8_t { ING_NOTIFY, ING_POLL, ING_COUNT };
+
+struct LatHist {
+  uint32_t n, sumMs, maxMs;
+  uint16_t neg;
+  uint16_t hist[LAT_BUCKETS];
+};
+
+struct ChLatency {
+  char cnt[24];            // channel the figures belong to ("" until first use)
+  uint32_t lastRiHash;     // ri of the last recorded CIN
+  LatHist ing[ING_COUNT];
+};
+
+static ChLatency lat[MAX_TANKS][MAX_CH_PER_TANK];
+
+static const char* const ingNames[ING_COUNT] = { "notify", "poll" };
+
+static int64_t epochMs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < 1700000000) return 0; // clock not set yet
+  return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// 250 ms doubling up to 32 s, then overflow
+static uint8_t bucketOf(uint32_t ms) {
+  uint8_t b = 0;
+  for (uint32_t bound = 250; b < LAT_BUCKETS - 1 && ms >= bound; bound <<= 1) b++;
+  return b;
+}
+
+void latencyRecord(const Tank& t, const Channel& c, const Command& cmd) {
+  if (cmd.src != SRC_NOTIFY && cmd.src != SRC_POLL) return;
+  uint32_t ct = ctToEpoch(cmd.ct);
+  int64_t now = epochMs();
+  if (!ct || !now) return;
+
+  ChLatency& L = lat[&t - tanks][&c - t.ch];
+  if (!L.cnt[0]) strlcpy(L.cnt, c.cnt, sizeof(L.cnt));
+  uint32_t h = fnv1a(cmd.ri);
+  if (cmd.ri.length() && h == L.lastRiHash) return;
+  L.lastRiHash = h;
+
+  // ct + 0.5 s in the CSE clock, moved into the device clock
+  int64_t ms = now - ((int64_t)ct * 1000 + 500 - cseSkewMs());
+  if (ms > (int64_t)LAT_IGNORE_MS) return;
+  LatHist& H = L.ing[cmd.src == SRC_NOTIFY ? ING_NOTIFY : ING_POLL];
+  if (ms < 0) {
+    if (H.neg < 0xFFFF) H.neg++;
+    ms = 0;
+  }
+  H.n++;
+  H.sumMs += (uint32_t)ms;
+  if ((uint32_t)ms > H.maxMs) H.maxMs = (uint32_t)ms;
+  uint16_t& b = H.hist[bucketOf((uint32_t)ms)];
+  if (b < 0xFFFF) b++;
+}
+
+void latencyTableChanged(const Tank& t) {
+  ChLatency* row = lat[&t - tanks];
+  // Figures follow the channel by cnt; a channel new to the table starts empty
+  ChLatency prev[MAX_CH_PER_TANK];
+  memcpy(prev, row, sizeof(prev));
+  for (uint8_t k = 0; k < MAX_CH_PER_TANK; k++) {
+    ChLatency& L = row[k];
+    L = ChLatency{};
+    if (k >= t.nch) continue;
+    for (uint8_t j = 0; j < MAX_CH_PER_TANK; j++) {
+      if (prev[j].cnt[0] && !strcmp(prev[j].cnt, t.ch[k].cnt)) { L = prev[j]; break; }
+    }
+    strlcpy(L.cnt, t.ch[k].cnt, sizeof(L.cnt));
+  }
+}
+
+String latencySummary() {
+  uint32_t n[ING_COUNT] = {0}, sum[ING_COUNT] = {0};
+  for (uint8_t i = 0; i < tankCount; i++) {
+    for (uint8_t k = 0; k < tanks[i].nch; k++) {
+      for (uint8_t g = 0; g < ING_COUNT; g++) {
+        n[g] += lat[i][k].ing[g].n;
+        sum[g] += lat[i][k].ing[g].sumMs;
+      }
+    }
+  }
+  String s = "[";
+  for (uint8_t g = 0; g < ING_COUNT; g++) {
+    s += "[" + String(n[g]) + "," + String(n[g] ? sum[g] / n[g] : 0) + "],";
+  }
+  return s + String(cseSkewMs()) + "]";
+}
+
+static void handleLatency() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  Tank* t = findTank(server.arg("ae"));
+  if (!t && !server.hasArg("ae") && tankCount) t = &tanks[0];
+  if (!t) { server.send(404, "text/plain", "unknown ae"); return; }
+
+  String body = "{\"skew_ms\":" + String(cseSkewMs()) + ",\"skew_n\":" + String(cseSkewSamples()) + ",\"bounds\":[";
+  for (uint8_t b = 0; b < LAT_BUCKETS - 1; b++) body += String(b ? "," : "") + String(250UL << b);
+  body += "],\"ch\":[";
+  for (uint8_t k = 0; k < t->nch; k++) {
+    body += String(k ? "," : "") + "{\"cnt\":\"" + t->ch[k].cnt + "\"";
+    for (uint8_t g = 0; g < ING_COUNT; g++) {
+      const LatHist& H = lat[t - tanks][k].ing[g];
+      body += String(",\"") + ingNames[g] + "\":{\"n\":" + String(H.n) +
+              ",\"avg\":" + String(H.n ? H.sumMs / H.n : 0) + ",\"max\":" + String(H.maxMs) +
+              ",\"neg\":" + String(H.neg) + ",\"hist\":[";
+      for (uint8_t b = 0; b < LAT_BUCKETS; b++) body += String(b ? "," : "") + String(H.hist[b]);
+      body += "]}";
+    }
+    body += "}";
+  }
+  body += "]}";
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", body);
+}
+
+void latencyInit() {
+  server.on("/latency", HTTP_GET, handleLatency);
+}
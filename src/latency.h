@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Cloud-to-relay latency
+// =========================
+// For every command applied from a CIN (notify or poll ingress) the time
+// from the CIN's creation on Mobius (ct) to the relay write is recorded in a
+// histogram per channel and ingress. The first application of a CIN counts;
+// a later re-delivery of the same ri (e.g. the next poll) does not, nor does
+// a CIN older than LAT_IGNORE_MS (the latest one found at boot or after an
+// outage).
+//
+// ct is in the CSE's clock with one-second resolution, so it is taken as
+// ct + 0.5 s and moved into the device clock with the skew estimated from
+// Mobius' Date headers (cse_time.h).
+//
+// Bucket upper bounds: 250, 500, 1000 ... 32000 ms and one overflow bucket.
+//   GET /latency[?ae=]   (LAN token)
+//   -> {"skew_ms":..,"skew_n":..,"bounds":[..],
+//       "ch":[{"cnt":..,"notify":{"n":..,"avg":..,"max":..,"neg":..,"hist":[..]},
+//              "poll":{..}},..]}
+// "neg" counts samples that came out negative (clamped to 0), a sign that
+// the skew estimate is off.
+
+static const uint8_t LAT_BUCKETS = 9;
+static const uint32_t LAT_IGNORE_MS = 10UL * 60UL * 1000UL; // older CINs (boot, outage) are not latency
+
+void latencyInit();
+
+// Called by the relay layer for every applied command
+void latencyRecord(const Tank& t, const Channel& c, const Command& cmd);
+
+// The tank's channel table was replaced (remote config): figures move with
+// their channel's cnt, a new channel starts empty
+void latencyTableChanged(const Tank& t);
+
+// Device-wide figures for the diagnostics report:
+//   [[notify n, avg ms],[poll n, avg ms],skew ms]
+String latencySummary();
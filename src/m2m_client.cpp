@@ -0,0 +1,334 @@
+#include "m2m_client.h"
+#include "net_ledger.h"
+#include "flight_rec.h"
+#include "cse_time.h"
+#include <HTTPClient.h>
+#include <Preferences.h>
+
+// Root CA (Server certificate issuing CA must match)
+static const char root_ca_pem[] = R"EOF(
+-----BEGIN CERTIFICATE-----
+
+-----END CERTIFICATE-----
+)EOF";
+
+// ===== TLS Client =====
+WiFiClientSecure secureClient;
+static HTTPClient mobiusHttp; // kept across requests so the TLS session is reused
+
+// X-M2M-RI = <device id>-<boot>-<seq>: unique across reboots and devices, so
+// Mobius access logs join with the device's request spans (net_ledger.h)
+static char riPrefix[24] = "0-0";
+static uint32_t reqSeq = 0;
+
+// =========================
+// CSE endpoints
+// =========================
+struct Endpoint {
+  String base;
+  String host;             // from base, for the timed DNS/connect
+  uint16_t port;
+  uint32_t rttMs;          // EWMA of the request round trip, 0 = never answered
+  uint16_t errPermille;    // EWMA of the failure rate
+  uint8_t fails;           // consecutive failures (circuit breaker)
+  bool open;               // circuit open: skipped until the cooldown allows a probe
+  bool subsChecked;        // subscriptions verified on this CSE since boot
+  unsigned long openedMs;
+  uint32_t requests, errors;
+};
+
+static Endpoint eps[M2M_MAX_ENDPOINTS];
+static uint8_t epCount = 0;
+static int8_t active = -1; // endpoint the kept-alive session belongs to
+
+static bool failedCode(int code) { return code < 0 || code >= 500; }
+
+bool m2mCircuitOpen() {
+  // Only when no endpoint is left to fail over to
+  for (uint8_t i = 0; i < epCount; i++) if (!eps[i].open) return false;
+  return true;
+}
+
+static void circuitRecord(Endpoint& e, int code, uint32_t rtt) {
+  e.requests++;
+  if (!failedCode(code)) {
+    e.rttMs = e.rttMs ? e.rttMs + ((int32_t)rtt - (int32_t)e.rttMs) / 4 : rtt;
+    e.errPermille -= e.errPermille / 8;
+    if (e.open) {
+      Serial.printf("[M2M] %s circuit closed\n", e.base.c_str());
+      e.errPermille /= 2;
+    }
+    e.fails = 0;
+    e.open = false;
+    return;
+  }
+  e.errors++;
+  e.errPermille += (1000 - e.errPermille) / 8;
+  if (e.fails < 255) e.fails++;
+  if (e.fails >= M2M_CIRCUIT_FAILS) {
+    if (!e.open) Serial.printf("[M2M] %s circuit open after %u failures\n", e.base.c_str(), e.fails);
+    e.open = true;
+    e.openedMs = millis(); // (re)start cooldown, also after a failed probe
+  }
+}
+
+static bool probeDue(const Endpoint& e) {
+  return e.open && millis() - e.openedMs >= M2M_CIRCUIT_COOLDOWN_MS;
+}
+
+// Lower is better. Endpoints that never answered rank after every measured
+// one, in list order; the error rate inflates the RTT up to 5x.
+static uint32_t score(const Endpoint& e) {
+  if (!e.rttMs) return UINT32_MAX / 2;
+  return e.rttMs + e.rttMs * e.errPermille * 4 / 1000;
+}
+
+// Healthiest usable endpoint other than `skip`, -1 if all are open.
+// The current one is kept unless another is clearly better, since a switch
+// costs a TLS handshake. A preferred (earlier) endpoint whose cooldown has
+// run out is tried again, so the device drifts back once it recovers.
+static int8_t pickEndpoint(int8_t skip) {
+  int8_t best = -1;
+  for (uint8_t i = 0; i < epCount; i++) {
+    if (i == skip) continue;
+    if (probeDue(eps[i]) && (best < 0 || i < active)) return i;
+    if (eps[i].open) continue;
+    if (best < 0 || score(eps[i]) < score(eps[best])) best = i;
+  }
+  if (best >= 0 && active >= 0 && active != skip && active != best && !eps[active].open &&
+      (uint64_t)score(eps[active]) * 100 <= (uint64_t)score(eps[best]) * M2M_SWITCH_MARGIN_PCT) {
+    best = active;
+  }
+  return best;
+}
+
+static void useEndpoint(int8_t i) {
+  if (i == active) return;
+  mobiusHttp.end();
+  secureClient.stop();
+  if (active >= 0) {
+    Serial.printf("[M2M] endpoint %s -> %s\n", eps[active].base.c_str(), eps[i].base.c_str());
+    // nu registrations live on the CSE: verify them once on every CSE we move to
+    if (!eps[i].subsChecked) {
+      for (uint8_t k = 0; k < tankCount; k++) tanks[k].subsDirty = true;
+    }
+  }
+  eps[i].subsChecked = true; // at boot the first one is registered by subscriptionsInit
+  active = i;
+}
+
+static const char* nextRi() {
+  static char buf[36];
+  snprintf(buf, sizeof(buf), "%s-%lu", riPrefix, (unsigned long)++reqSeq);
+  return buf;
+}
+
+// Device id (low 24 bits of the factory MAC) and a boot counter in NVS,
+// written once per boot
+static void initRiPrefix() {
+  Preferences prefs;
+  prefs.begin("m2m", false);
+  uint32_t boot = prefs.getUInt("boot", 0) + 1;
+  prefs.putUInt("boot", boot);
+  prefs.end();
+  uint64_t mac = ESP.getEfuseMac(); // byte 0 of the MAC in the low bits
+  uint32_t dev = (uint32_t)((mac >> 24 & 0xFF) << 16 | (mac >> 32 & 0xFF) << 8 | (mac >> 40 & 0xFF));
+  snprintf(riPrefix, sizeof(riPrefix), "%06lx-%lu", (unsigned long)dev, (unsigned long)boot);
+  Serial.printf("[M2M] request ids %s-<seq>\n", riPrefix);
+}
+
+void m2mInit() {
+  initRiPrefix();
+  secureClient.setCACert(root_ca_pem);
+  secureClient.setHandshakeTimeout(M2M_TLS_TIMEOUT_S);
+  mobiusHttp.setReuse(true);
+  static const char* keys[] = { "Date" }; // CSE clock estimate (cse_time.h)
+  mobiusHttp.collectHeaders(keys, 1);
+  mobiusHttp.setConnectTimeout(M2M_CONNECT_TIMEOUT_MS);
+  mobiusHttp.setTimeout(M2M_READ_TIMEOUT_MS);
+  if (!epCount) {
+    String list[M2M_MAX_ENDPOINTS];
+    uint8_t n = 0;
+    for (const char* base : MOBIUS_ENDPOINTS) if (n < M2M_MAX_ENDPOINTS) list[n++] = base;
+    m2mSetEndpoints(list, n);
+  }
+}
+
+void m2mSetEndpoints(const String* bases, uint8_t n) {
+  mobiusHttp.end();
+  secureClient.stop();
+  active = -1;
+  epCount = 0;
+  for (uint8_t i = 0; i < n && epCount < M2M_MAX_ENDPOINTS; i++) {
+    if (!bases[i].length()) continue;
+    Endpoint& e = eps[epCount++];
+    e = Endpoint();
+    e.base = bases[i];
+    if (e.base.endsWith("/")) e.base.remove(e.base.length() - 1);
+    int hs = e.base.indexOf("://");
+    e.host = hs < 0 ? e.base : e.base.substring(hs + 3);
+    if (e.host.indexOf('/') >= 0) e.host.remove(e.host.indexOf('/'));
+    int colon = e.host.indexOf(':');
+    e.port = colon < 0 ? 443 : (uint16_t)e.host.substring(colon + 1).toInt();
+    if (colon >= 0) e.host.remove(colon);
+  }
+}
+
+uint8_t m2mEndpointCount() {
+  return epCount;
+}
+
+const String& m2mEndpoint(uint8_t i) {
+  return eps[i].base;
+}
+
+String m2mEndpointStats() {
+  String s = "[";
+  for (uint8_t i = 0; i < epCount; i++) {
+    const Endpoint& e = eps[i];
+    if (i) s += ",";
+    s += "{\"url\":\"" + e.base + "\",\"rtt\":" + String(e.rttMs) +
+         ",\"err\":" + String(e.errPermille) + ",\"req\":" + String(e.requests) +
+         ",\"fail\":" + String(e.errors) + ",\"open\":" + (e.open ? "1" : "0") +
+         ",\"active\":" + (i == active ? "1" : "0") + "}";
+  }
+  return s + "]";
+}
+
+// ===== Utilities =====
+String makeUrl(const String& path) {
+  if (active < 0) return path;
+  return eps[active].base + "/" + path;
+}
+
+String aePath(const Tank& t) {
+  return String(CSEBASE) + "/" + t.ae;
+}
+
+String cntPath(const Tank& t, const char* cnt) {
+  return aePath(t) + "/" + cnt;
+}
+
+// Request line and headers HTTPClient writes itself (Host, User-Agent,
+// Connection, Accept-Encoding, Content-Length), for the byte ledger
+static const size_t HTTPCLIENT_HEAD_BYTES = 150;
+
+// Returns the bytes of the header lines added
+static size_t setCommonHeaders(HTTPClient& http, const Tank& t, bool hasBody, int ty, const char* ri) {
+  size_t n = 0;
+  auto add = [&](const char* name, const String& value) {
+    http.addHeader(name, value);
+    n += strlen(name) + value.length() + 4;
+  };
+  add("Accept", "application/json");
+  if (hasBody) {
+    if (ty > 0) add("Content-Type", "application/json; ty=" + String(ty));
+    else        add("Content-Type", "application/json");
+  }
+  add("X-M2M-Origin", t.origin);
+  add("X-M2M-RI", ri);
+  add("X-M2M-RVI", "4");
+  return n;
+}
+
+// With no live session, opens TCP+TLS ahead of HTTPClient so that the lookup
+// and the connect/handshake are timed apart; HTTPClient then reuses it.
+// Returns 0 or an HTTPClient error.
+static int openSession(const Endpoint& e, NetSample& s) {
+  if (secureClient.connected()) return 0;
+  s.handshake = true;
+  unsigned long t = millis();
+  IPAddress ip;
+  bool resolved = WiFi.hostByName(e.host.c_str(), ip);
+  s.ms[PH_DNS] = millis() - t;
+  if (!resolved) {
+    Serial.printf("[M2M] DNS fail: %s\n", e.host.c_str());
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  t = millis();
+  // lwIP caches the lookup above, so this is the TCP connect and TLS handshake
+  bool ok = secureClient.connect(e.host.c_str(), e.port, M2M_CONNECT_TIMEOUT_MS);
+  s.ms[PH_CONN] = millis() - t;
+  if (!ok) {
+    Serial.printf("[M2M] connect fail: %s:%u\n", e.host.c_str(), e.port);
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  return 0;
+}
+
+// One attempt on endpoint i, recorded in the network ledger
+static int m2mAttempt(int8_t i, const Tank& t, const char* method, const String& path,
+                      int ty, const String* body, String& resp, const char* ri) {
+  useEndpoint(i);
+  NetSample s = {};
+  s.op = netOpOf(method, ty, path);
+  s.ri = ri;
+  s.ep = i;
+  frNote(FR_REQ, s.op, i);
+  unsigned long t0 = millis();
+
+  String url = makeUrl(path);
+  int code = openSession(eps[i], s);
+  if (code == 0 && !mobiusHttp.begin(secureClient, url)) {
+    Serial.printf("[M2M] begin fail: %s\n", url.c_str());
+    code = -1;
+  }
+  if (code == 0) {
+    s.tx = setCommonHeaders(mobiusHttp, t, body != nullptr, ty, ri) + HTTPCLIENT_HEAD_BYTES +
+           strlen(method) + path.length() + (body ? body->length() : 0);
+    unsigned long ts = millis();
+    code = mobiusHttp.sendRequest(method, body ? *body : String());
+    s.ms[PH_TTFB] = millis() - ts;
+    if (code > 0) {
+      cseClockSample(mobiusHttp.header("Date"), ts, s.ms[PH_TTFB]);
+      ts = millis();
+      resp = mobiusHttp.getString();
+      s.ms[PH_BODY] = millis() - ts;
+      s.rx = resp.length();
+    }
+    mobiusHttp.end(); // keeps the connection open when the server allows it
+  }
+
+  s.ms[PH_TOTAL] = millis() - t0;
+  s.failed = failedCode(code);
+  s.code = code;
+  frNote(FR_RSP, s.op, (uint16_t)code);
+  netLedgerRecord(s, method, path);
+  // Session setup is excluded, it would penalise whichever CSE was just switched to
+  circuitRecord(eps[i], code, s.ms[PH_TTFB] + s.ms[PH_BODY]);
+  return code;
+}
+
+static int m2mRequest(const Tank& t, const char* method, const String& path,
+                      int ty, const String* body, String& resp, const char* ri = nullptr) {
+  resp = "";
+  if (!ri) ri = nextRi();
+  // Every circuit open: fail fast until a cooldown allows one probe
+  int8_t i = pickEndpoint(-1);
+  if (i < 0) return M2M_ERR_CIRCUIT_OPEN;
+
+  int code = m2mAttempt(i, t, method, path, ty, body, resp, ri);
+  if (!failedCode(code)) return code;
+
+  // Fail over within the same call, same RI. Journal CINs carry a fixed rn,
+  // so a create that did reach the first CSE is answered with 409 there
+  int8_t alt = pickEndpoint(i);
+  if (alt < 0) return code;
+  Serial.printf("[M2M] %s %s failed (%d), retrying on %s\n", method, path.c_str(), code,
+                eps[alt].base.c_str());
+  resp = "";
+  return m2mAttempt(alt, t, method, path, ty, body, resp, ri);
+}
+
+int m2mGet(const Tank& t, const String& path, String& resp) {
+  return m2mRequest(t, "GET", path, 0, nullptr, resp);
+}
+
+int m2mPost(const Tank& t, const String& path, int ty, const String& body, String& resp,
+            const char* ri) {
+  return m2mRequest(t, "POST", path, ty, &body, resp, ri);
+}
+
+int m2mPut(const Tank& t, const String& path, const String& body, String& resp) {
+  return m2mRequest(t, "PUT", path, 0, &body, resp);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include "tank.h"
+
+// =========================
+// Mobius client
+// =========================
+// Every request from every tank goes through one TLS session that is kept
+// alive between calls, so the connection count does not grow with tanks.
+//
+// The CSE can be an ordered list of endpoints. Each keeps an EWMA of its RTT
+// and failure rate plus its own circuit breaker; requests go to the healthiest
+// one and a failed request is retried once on the next, so a dead CSE costs
+// one connect timeout rather than a stall. Moving to a CSE not used since boot
+// marks every tank's subscriptions dirty, so subscriptionService() re-checks
+// (and corrects) the nu registrations there. Every attempt is timed by phase
+// into the network ledger (net_ledger.h).
+
+extern WiFiClientSecure secureClient;
+
+void m2mInit();
+
+String makeUrl(const String& path);
+
+// Runtime CSE endpoint list (ordered by preference); replacing it drops the
+// kept-alive session and the health history
+void m2mSetEndpoints(const String* bases, uint8_t n);
+uint8_t m2mEndpointCount();
+const String& m2mEndpoint(uint8_t i);
+// JSON array with per-endpoint rtt/err (per mille)/req/fail/open/active
+String m2mEndpointStats();
+String aePath(const Tank& t);                    // Mobius/<ae>
+String cntPath(const Tank& t, const char* cnt);  // Mobius/<ae>/<cnt>
+
+// Returns the HTTP status (or a negative HTTPClient error) and the body in resp.
+// ty > 0 sends "Content-Type: application/json; ty=<ty>" (resource create).
+int m2mGet(const Tank& t, const String& path, String& resp);
+// ri overrides the generated X-M2M-RI (replayed journal records keep theirs).
+int m2mPost(const Tank& t, const String& path, int ty, const String& body, String& resp,
+            const char* ri = nullptr);
+int m2mPut(const Tank& t, const String& path, const String& body, String& resp);
+
+// Circuit breaker state: true while every endpoint is failing fast
+bool m2mCircuitOpen();
+
+// Returned instead of a network attempt while every circuit is open
+static const int M2M_ERR_CIRCUIT_OPEN = -100;
@@ -0,0 +1,170 @@
+#include "net_ledger.h"
+#include "notify.h"
+#include "lan_api.h"
+#include <sys/time.h>
+
+struct OpLedger {
+  uint32_t n, failed, handshakes;
+  uint32_t tx, rx;
+  uint32_t ms[PH_COUNT];
+  uint16_t hist[PH_COUNT][NET_HIST_BUCKETS];
+};
+
+static OpLedger ledger[NET_OP_COUNT];
+
+struct Span {
+  char ri[36];
+  uint32_t atSec;          // start, epoch seconds (uptime before NTP)
+  uint16_t atMs;
+  uint8_t op, ep;
+  int16_t code;
+  uint16_t ms[PH_COUNT];   // saturated at 65535
+};
+
+static Span spans[NET_SPANS];
+static uint8_t spanHead = 0, spanCount = 0;
+
+static const char* const opNames[NET_OP_COUNT] = {
+  "sub_create", "sub_get", "sub_put", "la", "cin", "grp", "other"
+};
+static const char* const phaseNames[PH_COUNT] = { "dns", "conn", "ttfb", "body", "total" };
+
+NetOp netOpOf(const char* method, int ty, const String& path) {
+  bool post = strcmp(method, "POST") == 0;
+  if (post && ty == 23) return NET_SUB_CREATE;
+  if (post && ty == 4) return NET_CIN;
+  if (post && ty == 9) return NET_GRP;
+  if (path.indexOf("/sub_") >= 0) return strcmp(method, "GET") == 0 ? NET_SUB_GET : NET_SUB_PUT;
+  if (path.endsWith("/la") || path.indexOf("/la?") >= 0) return NET_LA;
+  if (path.indexOf("/grp_") >= 0) return NET_GRP;
+  return NET_OTHER;
+}
+
+// 25 ms doubling up to 3200, then overflow
+static uint8_t bucketOf(uint32_t ms) {
+  uint8_t b = 0;
+  for (uint32_t bound = 25; b < NET_HIST_BUCKETS - 1 && ms >= bound; bound <<= 1) b++;
+  return b;
+}
+
+static void count(OpLedger& l, uint8_t ph, uint32_t ms) {
+  l.ms[ph] += ms;
+  uint16_t& h = l.hist[ph][bucketOf(ms)];
+  if (h < 0xFFFF) h++;
+}
+
+static void addSpan(const NetSample& s) {
+  Span& sp = spans[spanHead];
+  spanHead = (spanHead + 1) % NET_SPANS;
+  if (spanCount < NET_SPANS) spanCount++;
+
+  strlcpy(sp.ri, s.ri ? s.ri : "", sizeof(sp.ri));
+  // The sample ends now: back-date the start by its total
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  uint64_t startMs = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - s.ms[PH_TOTAL];
+  sp.atSec = (uint32_t)(startMs / 1000);
+  sp.atMs = startMs % 1000;
+  sp.op = s.op;
+  sp.ep = s.ep;
+  sp.code = s.code;
+  for (uint8_t p = 0; p < PH_COUNT; p++) sp.ms[p] = s.ms[p] > 0xFFFF ? 0xFFFF : s.ms[p];
+}
+
+void netLedgerRecord(const NetSample& s, const char* method, const String& path) {
+  addSpan(s);
+  OpLedger& l = ledger[s.op];
+  l.n++;
+  if (s.failed) l.failed++;
+  l.tx += s.tx;
+  l.rx += s.rx;
+  if (s.handshake) {
+    l.handshakes++;
+    count(l, PH_DNS, s.ms[PH_DNS]);
+    count(l, PH_CONN, s.ms[PH_CONN]);
+  }
+  count(l, PH_TTFB, s.ms[PH_TTFB]);
+  count(l, PH_BODY, s.ms[PH_BODY]);
+  count(l, PH_TOTAL, s.ms[PH_TOTAL]);
+
+  if (s.ms[PH_TOTAL] >= NET_SLOW_MS) {
+    Serial.printf("[NET] slow %s %s ri=%s: %lums (dns %lu, conn %lu, ttfb %lu, body %lu)\n",
+                  method, path.c_str(), s.ri ? s.ri : "", (unsigned long)s.ms[PH_TOTAL],
+                  (unsigned long)s.ms[PH_DNS], (unsigned long)s.ms[PH_CONN],
+                  (unsigned long)s.ms[PH_TTFB], (unsigned long)s.ms[PH_BODY]);
+  }
+}
+
+static String opTotals(const OpLedger& l) {
+  String s = "\"n\":" + String(l.n) + ",\"fail\":" + String(l.failed) +
+             ",\"hs\":" + String(l.handshakes) + ",\"tx\":" + String(l.tx) +
+             ",\"rx\":" + String(l.rx) + ",\"ms\":[";
+  for (uint8_t p = 0; p < PH_COUNT; p++) s += String(p ? "," : "") + String(l.ms[p]);
+  return s + "]";
+}
+
+String netLedgerCompact() {
+  String s = "{";
+  bool first = true;
+  for (uint8_t o = 0; o < NET_OP_COUNT; o++) {
+    const OpLedger& l = ledger[o];
+    if (!l.n) continue;
+    s += String(first ? "" : ",") + "\"" + opNames[o] + "\":[" + String(l.n) + "," +
+         String(l.failed) + "," + String(l.handshakes) + "," + String(l.tx) + "," +
+         String(l.rx) + "," + String(l.ms[PH_TOTAL]) + ",[";
+    for (uint8_t b = 0; b < NET_HIST_BUCKETS; b++) s += String(b ? "," : "") + String(l.hist[PH_TOTAL][b]);
+    s += "]]";
+    first = false;
+  }
+  return s + "}";
+}
+
+uint32_t netLedgerFailures() {
+  uint32_t n = 0;
+  for (const OpLedger& l : ledger) n += l.failed;
+  return n;
+}
+
+static void handleNet() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  String body = "{\"bounds\":[";
+  for (uint8_t b = 0; b < NET_HIST_BUCKETS - 1; b++) body += String(b ? "," : "") + String(25UL << b);
+  body += "],\"phases\":[";
+  for (uint8_t p = 0; p < PH_COUNT; p++) body += String(p ? "," : "") + "\"" + phaseNames[p] + "\"";
+  body += "],\"ops\":{";
+  for (uint8_t o = 0; o < NET_OP_COUNT; o++) {
+    const OpLedger& l = ledger[o];
+    body += String(o ? "," : "") + "\"" + opNames[o] + "\":{" + opTotals(l) + ",\"hist\":[";
+    for (uint8_t p = 0; p < PH_COUNT; p++) {
+      body += p ? ",[" : "[";
+      for (uint8_t b = 0; b < NET_HIST_BUCKETS; b++) body += String(b ? "," : "") + String(l.hist[p][b]);
+      body += "]";
+    }
+    body += "]}";
+  }
+  body += "}}";
+  if (server.arg("reset") == "1") memset(ledger, 0, sizeof(ledger));
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", body);
+}
+
+static void handleSpans() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  String body = "{\"spans\":[";
+  for (uint8_t i = 0; i < spanCount; i++) {
+    const Span& sp = spans[(spanHead + NET_SPANS - spanCount + i) % NET_SPANS];
+    char row[128];
+    snprintf(row, sizeof(row), "%s[\"%s\",%lu,%u,\"%s\",%u,%d,%u,%u,%u,%u,%u]", i ? "," : "",
+             sp.ri, (unsigned long)sp.atSec, sp.atMs, opNames[sp.op], sp.ep, sp.code,
+             sp.ms[PH_DNS], sp.ms[PH_CONN], sp.ms[PH_TTFB], sp.ms[PH_BODY], sp.ms[PH_TOTAL]);
+    body += row;
+  }
+  body += "]}";
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", body);
+}
+
+void netLedgerInit() {
+  server.on("/net", HTTP_GET, handleNet);
+  server.on("/net/spans", HTTP_GET, handleSpans);
+}
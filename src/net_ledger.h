@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+
+// =========================
+// Network cost ledger
+// =========================
+// Every Mobius request is recorded by type with its phases:
+//   dns   host lookup            (new session only)
+//   conn  TCP connect + TLS      (new session only; WiFiClientSecure does both
+//                                 in one call, so they are not split further)
+//   ttfb  request sent until the response head is parsed
+//   body  response body read
+//   total the whole attempt
+// plus bytes sent (request line, headers, body) and received (body), and the
+// number of TLS handshakes, which dominate airtime on a busy device.
+// Per type and phase there is a total and a histogram with bucket upper
+// bounds of 25, 50, 100, ... 3200 ms and one overflow bucket.
+// Requests slower than NET_SLOW_MS are logged with their breakdown.
+//
+// The last NET_SPANS attempts are also kept as spans keyed by their X-M2M-RI
+// (<device id>-<boot>-<seq>), so they join with the Mobius access log:
+//   GET /net/spans   (LAN token)
+//   -> {"spans":[["<ri>",<start epoch s>,<ms>,"<type>",<endpoint>,<code>,
+//                 dns,conn,ttfb,body,total],...]}   oldest first
+// A request retried on another endpoint keeps its RI and has two spans.
+//
+//   GET /net[?reset=1]   (LAN token)
+//   -> {"bounds":[25,...],"phases":["dns",...],
+//       "ops":{"la":{"n":..,"fail":..,"hs":..,"tx":..,"rx":..,
+//                    "ms":[dns,conn,ttfb,body,total],"hist":[[..],..]},..}}
+
+enum NetOp : uint8_t {
+  NET_SUB_CREATE, NET_SUB_GET, NET_SUB_PUT, NET_LA, NET_CIN, NET_GRP, NET_OTHER,
+  NET_OP_COUNT
+};
+
+enum NetPhase : uint8_t { PH_DNS, PH_CONN, PH_TTFB, PH_BODY, PH_TOTAL, PH_COUNT };
+
+static const uint8_t NET_HIST_BUCKETS = 9;
+static const uint32_t NET_SLOW_MS = 2000;
+static const uint8_t NET_SPANS = 32;
+
+struct NetSample {
+  NetOp op;
+  const char* ri;          // X-M2M-RI sent
+  uint8_t ep;              // endpoint index
+  bool handshake;          // a new TCP+TLS session was opened
+  bool failed;             // transport error or 5xx
+  int16_t code;            // HTTP status or HTTPClient error
+  uint32_t ms[PH_COUNT];
+  uint32_t tx, rx;
+};
+
+void netLedgerInit();
+
+// Request type from what the client sends
+NetOp netOpOf(const char* method, int ty, const String& path);
+
+void netLedgerRecord(const NetSample& s, const char* method, const String& path);
+
+// Compact form for the diagnostics report, types with traffic only:
+//   {"la":[n,fail,hs,tx,rx,total ms,[total histogram]],...}
+String netLedgerCompact();
+
+// Failed attempts over all types since boot
+uint32_t netLedgerFailures();
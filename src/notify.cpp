@@ -0,0 +1,174 @@
+#include "notify.h"
+#include <WiFi.h>
+#include <ArduinoJson.h>
+#include <uri/UriBraces.h>
+#include "scenes.h"
+#include "cse_time.h"
+#include "ota.h"
+#include "flight_rec.h"
+#include "poller.h"
+#include <time.h>
+
+NotifyServer server(NOTIFY_PORT);
+
+String notifyUrl(const Tank& t, const char* cnt) {
+  return "http://" + WiFi.localIP().toString() + ":" + String(NOTIFY_PORT) +
+         "/n/" + t.ae + "/" + cnt;
+}
+
+String notifyUrl(const Tank& t, const Channel& c) {
+  return notifyUrl(t, c.cnt);
+}
+
+String notifyUrl(const Tank& t) {
+  return "http://" + WiFi.localIP().toString() + ":" + String(NOTIFY_PORT) + "/n/" + t.ae;
+}
+
+String containerFromSur(const String& sur) {
+  int end = sur.lastIndexOf('/');
+  if (end <= 0) return "";
+  int start = sur.substring(0, end).lastIndexOf('/');
+  return sur.substring(start + 1, end);
+}
+
+bool extractConRiFromNotify(const String& body, NotifyCin& out) {
+  StaticJsonDocument<2048> doc;
+  if (deserializeJson(doc, body) != DeserializationError::Ok) return false;
+
+  JsonVariant sgn = doc["m2m:sgn"]; if (sgn.isNull()) sgn = doc["sgn"];
+  if (sgn.isNull()) return false;
+  out.sur = sgn["sur"].as<String>();
+
+  JsonVariant nev = sgn["nev"]; if (nev.isNull()) return false;
+  JsonVariant rep = nev["rep"]; if (rep.isNull()) return false;
+  JsonVariant cin = rep["m2m:cin"]; if (cin.isNull()) return false;
+
+  JsonVariant con = cin["con"]; if (con.isNull()) return false;
+  out.con = con.as<String>(); out.con.trim();
+  unescapeCon(out.con);
+
+  JsonVariant ri = cin["ri"]; if (!ri.isNull()) out.ri = ri.as<String>(); else out.ri = "";
+  JsonVariant ct = cin["ct"]; if (!ct.isNull()) out.ct = ct.as<String>(); else out.ct = "";
+  return true;
+}
+
+// =========================
+// Notify Handler (routed by AE and container)
+// =========================
+static NotifyStats stats;
+
+NotifyStats notifyStats() {
+  return stats;
+}
+
+static void sendResult(CmdResult r) {
+  switch (r) {
+    case CMD_APPLIED: stats.applied++; server.send(200, "text/plain", "ok");      break;
+    case CMD_DUP:     stats.dup++;     server.send(200, "text/plain", "dup");     break;
+    case CMD_IGNORED: stats.ignored++; server.send(200, "text/plain", "ignored"); break;
+    case CMD_STALE:   stats.stale++;   server.send(200, "text/plain", "stale");   break;
+  }
+}
+
+// A notification flushed from the CSE's queue after we were unreachable
+static bool backlogged(const String& ct) {
+  time_t now = time(nullptr);
+  uint32_t at = ctToEpoch(ct);
+  return now > 1700000000 && at && now - (time_t)at > (time_t)NOTIFY_BACKLOG_S;
+}
+
+static void sendRejected(int code, const char* msg) {
+  stats.rejected++;
+  server.send(code, "text/plain", msg);
+}
+
+// cnt == "": group notification, the container is taken from "sur"
+static void handleNotifyFor(Tank* t, String cnt) {
+  stats.received++;
+  frNote(FR_NOTIFY, t ? t - tanks : 0xFF, 0);
+  if (!t) { sendRejected(404, "unknown ae"); return; }
+
+  String body = server.arg("plain");
+  if (body.isEmpty()) { sendRejected(400, "empty"); return; }
+
+  NotifyCin n;
+  if (!extractConRiFromNotify(body, n)) {
+    sendRejected(400, "no con");
+    Serial.printf("[NOTIFY][%s/%s] invalid payload\n", t->ae, cnt.length() ? cnt.c_str() : "grp");
+    return;
+  }
+  if (!cnt.length()) cnt = containerFromSur(n.sur);
+
+  // Backlog after an outage: acknowledge without actuating and retrieve the
+  // container's latest CIN once, however many of these arrive
+  if ((cnt == CNT_ALL || findChannel(*t, cnt)) && backlogged(n.ct)) {
+    stats.deferred++;
+    pollSoon(*t, cnt);
+    server.send(200, "text/plain", "deferred");
+    return;
+  }
+
+  if (cnt == CNT_ALL) {
+    sendResult(applyTankCon(*t, n.con, Command{false, SRC_NOTIFY, n.ri, n.ct}));
+    return;
+  }
+
+  if (cnt == CNT_CONFIG) {
+    // Not trusted (it can move the CSE and the pins): retrieve config/la instead
+    pollSoon(*t, cnt);
+    server.send(200, "text/plain", "queued");
+    return;
+  }
+
+  if (cnt == CNT_OTA && t == &tanks[0]) {
+    // Not trusted: the update is taken from the CIN retrieved from Mobius
+    otaCheckSoon();
+    server.send(200, "text/plain", "queued");
+    return;
+  }
+
+  Channel* c = findChannel(*t, cnt);
+  if (!c) {
+    sendRejected(404, "unknown channel");
+    Serial.printf("[NOTIFY][%s] no channel for %s (sur=%s)\n", t->ae, cnt.c_str(), n.sur.c_str());
+    return;
+  }
+  bool on = false;
+  if (!parseConToOnOff(n.con, on)) {
+    sendRejected(400, "bad con");
+    Serial.printf("[NOTIFY][%s/%s] con parse fail: %s\n", t->ae, c->name, n.con.c_str());
+    return;
+  }
+
+  sendResult(applyCommand(*t, *c, Command{on, SRC_NOTIFY, n.ri, n.ct}));
+}
+
+static void handleChannelNotify() {
+  handleNotifyFor(findTank(server.pathArg(0)), server.pathArg(1));
+}
+
+static void handleGroupNotify() {
+  handleNotifyFor(findTank(server.pathArg(0)), "");
+}
+
+WiFiClient NotifyServer::detachClient() {
+  WiFiClient c = _currentClient;
+  // An unconnected client: handleClient() then drops the request at once
+  // instead of waiting for the peer to close; the socket lives on in c
+  _currentClient = WiFiClient();
+  return c;
+}
+
+WiFiClient takeClient() {
+  return server.detachClient();
+}
+
+void notifyInit() {
+  // Request headers kept by the server (one list for every handler)
+  static const char* headers[] = { "Authorization", "Last-Event-ID", "If-None-Match" };
+  server.collectHeaders(headers, 3);
+  server.on(UriBraces("/n/{}/{}"), HTTP_ANY, handleChannelNotify);
+  server.on(UriBraces("/n/{}"),    HTTP_ANY, handleGroupNotify);
+  server.begin();
+  Serial.printf("[Actuator] HTTP server started on :%u\n", NOTIFY_PORT);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <Arduino.h>
+#include <WebServer.h>
+#include "tank.h"
+
+// =========================
+// Internal HTTP Server (Notify Reception)
+// =========================
+// One server for all tanks: per-channel subscriptions notify /n/<ae>/<cnt>,
+// the group subscription of a tank notifies /n/<ae>.
+//
+// WebServer::client() returns a copy, and after a handler the server keeps
+// its own reference to a still-open connection (waiting up to
+// HTTP_MAX_CLOSE_WAIT for the peer to close, accepting nothing else). The
+// subclass can drop that reference, so a streamed response does not hold
+// the server.
+class NotifyServer : public WebServer {
+public:
+  using WebServer::WebServer;
+  WiFiClient detachClient();
+};
+extern NotifyServer server;
+
+void notifyInit();
+
+// Detach the connection of the current request so a long response can be
+// written from loop(). The returned client is then the only owner of the
+// socket; the server sees no connection once the handler returns and goes
+// back to accepting requests at once.
+WiFiClient takeClient();
+
+// Notifications received since boot, by outcome
+struct NotifyStats {
+  uint32_t received;
+  uint32_t applied, dup, ignored, stale;
+  uint32_t rejected;   // 4xx: bad payload, unknown AE/channel
+  uint32_t deferred;   // backlogged (old ct): acknowledged, latest CIN polled instead
+};
+NotifyStats notifyStats();
+
+// Notification URI registered in the subscription of a channel
+String notifyUrl(const Tank& t, const Channel& c);
+String notifyUrl(const Tank& t); // group subscription
+
+// Notification URI for a container that is not a relay channel (e.g. "all")
+String notifyUrl(const Tank& t, const char* cnt);
+
+struct NotifyCin {
+  String con;
+  String ri;
+  String ct;
+  String sur; // subscription reference
+};
+
+// Mobius Notify Body - Extract "con", "ri", "ct" and "sur" strings
+bool extractConRiFromNotify(const String& body, NotifyCin& out);
+
+// Container name from a subscription reference ".../<ae>/<cnt>/<sub>"
+String containerFromSur(const String& sur);
@@ -0,0 +1,402 @@
+#include "ota.h"
+#include "journal.h"
+#include "m2m_client.h"
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <esp_ota_ops.h>
+#include <esp32/rom/miniz.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/md.h>
+
+enum OtaState : uint8_t { OTA_IDLE, OTA_HEADER, OTA_BASE, OTA_STREAM, OTA_REBOOT };
+
+enum : uint8_t { OP_END = 0x00, OP_COPY = 0x01, OP_ADD = 0x02, OP_DIFF = 0x03 };
+
+static const size_t OTA_SIGNED = 76;               // header bytes covered by the HMAC
+static const size_t OTA_HDR_SIZE = OTA_SIGNED + 32;
+static const size_t OTA_SLICE_BYTES = 8 * 1024;    // image bytes produced per loop pass
+static const size_t OTA_BASE_SLICE = 16 * 1024;    // running image bytes hashed per loop pass
+static const unsigned long OTA_STALL_MS = 15000;   // no data from the update server
+static const unsigned long OTA_REBOOT_DELAY_MS = 3000;
+
+// Plain HTTP on the LAN, separate from the Mobius TLS session
+static WiFiClient otaNet;
+static HTTPClient otaHttp;
+
+struct OtaJob {
+  OtaState state;
+  Tank* tank;
+  bool eof;
+  unsigned long lastDataMs;
+
+  const esp_partition_t* running;
+  const esp_partition_t* target;
+  esp_ota_handle_t handle;
+  uint32_t baseSize, targetSize;
+  uint8_t baseSha[32], targetSha[32];
+  uint8_t hdr[OTA_HDR_SIZE];
+  size_t hdrLen;
+  uint32_t baseHashed;
+  mbedtls_sha256_context sha;
+
+  // inflate
+  tinfl_decompressor* inf;
+  uint8_t* dict;           // TINFL_LZ_DICT_SIZE circular window
+  uint8_t* dictNext;
+  const uint8_t* pend;     // inflated bytes not yet consumed by the op parser
+  size_t pendLen;
+  uint8_t in[1024];
+  size_t inPos, inLen;
+  tinfl_status lastStatus;
+
+  // op parser
+  uint8_t op;
+  uint8_t opHdr[8];
+  uint8_t opHdrLen, opHdrNeed;
+  bool inOp;               // header parsed, payload in progress
+  uint32_t opOff, opLeft;
+  bool ended;
+
+  uint8_t out[4096];
+  size_t outLen;
+  uint32_t written;
+  unsigned long doneMs;
+};
+
+static OtaJob job;
+static bool checkPending = false;
+
+bool otaBusy() {
+  return job.state != OTA_IDLE;
+}
+
+static uint32_t rd32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static String hex(const uint8_t* b, size_t n) {
+  static const char* digits = "0123456789abcdef";
+  String s;
+  s.reserve(n * 2);
+  for (size_t i = 0; i < n; i++) { s += digits[b[i] >> 4]; s += digits[b[i] & 15]; }
+  return s;
+}
+
+static void otaReport(const char* result, const char* detail) {
+  String con = String("{\"result\":\"") + result + "\",\"detail\":\"" + detail +
+               "\",\"sha256\":\"" + hex(job.targetSha, 32) + "\",\"bytes\":" + String(job.written) + "}";
+  outboxPostCin(*job.tank, CNT_OTA, con);
+}
+
+static void otaCleanup() {
+  otaHttp.end();
+  otaNet.stop();
+  if (job.inf)  { free(job.inf);  job.inf = nullptr; }
+  if (job.dict) { free(job.dict); job.dict = nullptr; }
+  mbedtls_sha256_free(&job.sha);
+}
+
+static void otaFail(const char* why) {
+  Serial.printf("[OTA] failed: %s\n", why);
+  if (job.handle) { esp_ota_abort(job.handle); job.handle = 0; }
+  otaReport("error", why);
+  otaCleanup();
+  job.state = OTA_IDLE;
+}
+
+// Non-blocking read from the update server
+static size_t netRead(uint8_t* buf, size_t max) {
+  WiFiClient* s = otaHttp.getStreamPtr();
+  if (!s) { job.eof = true; return 0; }
+  int av = s->available();
+  if (av <= 0) {
+    if (!s->connected()) job.eof = true;
+    return 0;
+  }
+  size_t n = s->readBytes(buf, min((size_t)av, max));
+  if (n) job.lastDataMs = millis();
+  return n;
+}
+
+static bool otaRequest(Tank& t, const String& con) {
+  if (otaBusy()) { Serial.println("[OTA] busy, request ignored"); return false; }
+
+  StaticJsonDocument<512> doc;
+  if (deserializeJson(doc, con) != DeserializationError::Ok) return false;
+  String url = doc["url"].as<String>();
+  if (!url.startsWith("http://")) {
+    Serial.printf("[OTA] unsupported url: %s\n", url.c_str());
+    return false;
+  }
+
+  job = OtaJob{};
+  job.tank = &t;
+  mbedtls_sha256_init(&job.sha);
+
+  Serial.printf("[OTA] GET %s\n", url.c_str());
+  if (!otaHttp.begin(otaNet, url)) { otaFail("begin"); return false; }
+  int code = otaHttp.GET();
+  if (code != 200) {
+    Serial.printf("[OTA] HTTP %d\n", code);
+    otaFail("http");
+    return false;
+  }
+  job.lastDataMs = millis();
+  job.state = OTA_HEADER;
+  return true;
+}
+
+// =========================
+// Header / base check
+// =========================
+static void stepHeader() {
+  job.hdrLen += netRead(job.hdr + job.hdrLen, OTA_HDR_SIZE - job.hdrLen);
+  if (job.hdrLen < OTA_HDR_SIZE) {
+    if (job.eof) otaFail("short header");
+    return;
+  }
+  if (memcmp(job.hdr, "9PD2", 4) != 0) { otaFail("bad magic"); return; }
+
+  // The hashes below decide what gets booted, so the header must come from
+  // the key holder, not from whoever served the file
+  uint8_t want[32];
+  if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                      (const uint8_t*)OTA_SIGN_KEY, strlen(OTA_SIGN_KEY),
+                      job.hdr, OTA_SIGNED, want) != 0) { otaFail("hmac"); return; }
+  uint8_t diff = 0;
+  for (size_t i = 0; i < sizeof(want); i++) diff |= want[i] ^ job.hdr[OTA_SIGNED + i];
+  if (diff) { otaFail("bad signature"); return; }
+
+  job.baseSize = rd32(job.hdr + 4);
+  memcpy(job.baseSha, job.hdr + 8, 32);
+  job.targetSize = rd32(job.hdr + 40);
+  memcpy(job.targetSha, job.hdr + 44, 32);
+
+  // The same target twice (e.g. the latest CIN after the reboot): nothing to do
+  uint8_t applied[32] = {0};
+  Preferences prefs;
+  prefs.begin("ota", true);
+  prefs.getBytes("sha", applied, sizeof(applied));
+  prefs.end();
+  if (memcmp(applied, job.targetSha, 32) == 0) {
+    Serial.println("[OTA] target already installed");
+    otaCleanup();
+    job.state = OTA_IDLE;
+    return;
+  }
+
+  job.running = esp_ota_get_running_partition();
+  job.target  = esp_ota_get_next_update_partition(nullptr);
+  if (!job.running || !job.target)          { otaFail("no ota partition"); return; }
+  if (job.baseSize > job.running->size)     { otaFail("base size"); return; }
+  if (job.targetSize > job.target->size)    { otaFail("target size"); return; }
+
+  Serial.printf("[OTA] delta %u -> %u bytes, checking running image\n", job.baseSize, job.targetSize);
+  mbedtls_sha256_starts(&job.sha, 0);
+  job.state = OTA_BASE;
+}
+
+static void stepBase() {
+  uint8_t buf[1024];
+  size_t budget = OTA_BASE_SLICE;
+  while (budget && job.baseHashed < job.baseSize) {
+    size_t n = min((size_t)(job.baseSize - job.baseHashed), sizeof(buf));
+    if (esp_partition_read(job.running, job.baseHashed, buf, n) != ESP_OK) { otaFail("base read"); return; }
+    mbedtls_sha256_update(&job.sha, buf, n);
+    job.baseHashed += n;
+    budget -= min(budget, n);
+  }
+  if (job.baseHashed < job.baseSize) return;
+
+  uint8_t sha[32];
+  mbedtls_sha256_finish(&job.sha, sha);
+  if (memcmp(sha, job.baseSha, 32) != 0) { otaFail("delta is for another base image"); return; }
+
+  job.inf  = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+  job.dict = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+  if (!job.inf || !job.dict) { otaFail("no memory"); return; }
+  tinfl_init(job.inf);
+  job.dictNext = job.dict;
+  job.lastStatus = TINFL_STATUS_NEEDS_MORE_INPUT;
+
+  esp_err_t err = esp_ota_begin(job.target, job.targetSize, &job.handle);
+  if (err != ESP_OK) { job.handle = 0; otaFail("ota begin"); return; }
+
+  mbedtls_sha256_starts(&job.sha, 0);
+  job.opHdrNeed = 1;
+  job.lastDataMs = millis();
+  job.state = OTA_STREAM;
+  Serial.printf("[OTA] writing %s\n", job.target->label);
+}
+
+// =========================
+// Stream: inflate -> ops -> partition
+// =========================
+static bool flushOut() {
+  if (!job.outLen) return true;
+  if (job.written + job.outLen > job.targetSize) { otaFail("image too long"); return false; }
+  if (esp_ota_write(job.handle, job.out, job.outLen) != ESP_OK) { otaFail("ota write"); return false; }
+  mbedtls_sha256_update(&job.sha, job.out, job.outLen);
+  job.written += job.outLen;
+  job.outLen = 0;
+  return true;
+}
+
+// Op header byte(s) from the inflated stream; returns false on a bad op
+static bool parseOpHeader() {
+  while (job.pendLen && job.opHdrLen < job.opHdrNeed) {
+    job.opHdr[job.opHdrLen++] = *job.pend++;
+    job.pendLen--;
+    if (job.opHdrLen == 1 && job.opHdrNeed == 1) {
+      job.op = job.opHdr[0];
+      job.opHdrLen = 0;
+      switch (job.op) {
+        case OP_END:  job.ended = true; return true;
+        case OP_COPY: job.opHdrNeed = 8; break;
+        case OP_ADD:  job.opHdrNeed = 4; break;
+        case OP_DIFF: job.opHdrNeed = 8; break;
+        default: return false;
+      }
+    }
+  }
+  if (job.opHdrNeed > 1 && job.opHdrLen == job.opHdrNeed) {
+    if (job.op == OP_ADD) { job.opOff = 0; job.opLeft = rd32(job.opHdr); }
+    else                  { job.opOff = rd32(job.opHdr); job.opLeft = rd32(job.opHdr + 4); }
+    if (job.op != OP_ADD && (uint64_t)job.opOff + job.opLeft > job.baseSize) return false;
+    job.inOp = job.opLeft > 0;
+    job.opHdrLen = 0;
+    job.opHdrNeed = 1;
+  }
+  return true;
+}
+
+static bool inflateMore() {
+  if (job.inPos == job.inLen && job.lastStatus != TINFL_STATUS_HAS_MORE_OUTPUT) {
+    job.inPos = 0;
+    job.inLen = netRead(job.in, sizeof(job.in));
+    if (!job.inLen && !job.eof) return false; // wait for the network
+  }
+  size_t inBytes = job.inLen - job.inPos;
+  size_t outBytes = job.dict + TINFL_LZ_DICT_SIZE - job.dictNext;
+  mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (job.eof ? 0 : TINFL_FLAG_HAS_MORE_INPUT);
+  job.lastStatus = tinfl_decompress(job.inf, job.in + job.inPos, &inBytes,
+                                    job.dict, job.dictNext, &outBytes, flags);
+  job.inPos += inBytes;
+  job.pend = job.dictNext;
+  job.pendLen = outBytes;
+  job.dictNext += outBytes;
+  if (job.dictNext == job.dict + TINFL_LZ_DICT_SIZE) job.dictNext = job.dict;
+
+  if (job.lastStatus < 0) { otaFail("inflate"); return false; }
+  if (job.lastStatus == TINFL_STATUS_DONE && !outBytes && !job.ended) { otaFail("truncated delta"); return false; }
+  return outBytes > 0 || inBytes > 0;
+}
+
+static void finishImage() {
+  if (!flushOut()) return;
+  if (job.written != job.targetSize) { otaFail("image size mismatch"); return; }
+  uint8_t sha[32];
+  mbedtls_sha256_finish(&job.sha, sha);
+  if (memcmp(sha, job.targetSha, 32) != 0) { otaFail("sha256 mismatch"); return; }
+
+  esp_err_t err = esp_ota_end(job.handle);
+  job.handle = 0;
+  if (err != ESP_OK) { otaFail("ota end"); return; }
+  if (esp_ota_set_boot_partition(job.target) != ESP_OK) { otaFail("set boot"); return; }
+
+  Preferences prefs;
+  prefs.begin("ota", false);
+  prefs.putBytes("sha", job.targetSha, 32);
+  prefs.end();
+
+  Serial.printf("[OTA] done: %u bytes written, rebooting into %s\n", job.written, job.target->label);
+  otaReport("ok", job.target->label);
+  otaCleanup();
+  job.doneMs = millis();
+  job.state = OTA_REBOOT;
+}
+
+static void stepStream() {
+  size_t budget = OTA_SLICE_BYTES;
+  while (budget && job.state == OTA_STREAM) {
+    if (job.ended) { finishImage(); return; }
+
+    if (job.outLen == sizeof(job.out) && !flushOut()) return;
+    size_t room = min(sizeof(job.out) - job.outLen, budget);
+
+    if (job.inOp && job.op == OP_COPY) {
+      size_t n = min((size_t)job.opLeft, room);
+      if (esp_partition_read(job.running, job.opOff, job.out + job.outLen, n) != ESP_OK) { otaFail("base read"); return; }
+      job.outLen += n; job.opOff += n; job.opLeft -= n; budget -= n;
+      job.inOp = job.opLeft > 0;
+      continue;
+    }
+
+    if (!job.pendLen) {
+      if (!inflateMore()) return;
+      continue;
+    }
+
+    if (!job.inOp) {
+      if (!parseOpHeader()) { otaFail("bad op"); return; }
+      continue;
+    }
+
+    // ADD / DIFF payload from the inflated stream
+    size_t n = min(min((size_t)job.opLeft, job.pendLen), room);
+    uint8_t* dst = job.out + job.outLen;
+    if (job.op == OP_DIFF) {
+      if (esp_partition_read(job.running, job.opOff, dst, n) != ESP_OK) { otaFail("base read"); return; }
+      for (size_t i = 0; i < n; i++) dst[i] += job.pend[i];
+      job.opOff += n;
+    } else {
+      memcpy(dst, job.pend, n);
+    }
+    job.pend += n; job.pendLen -= n;
+    job.outLen += n; job.opLeft -= n; budget -= n;
+    job.inOp = job.opLeft > 0;
+  }
+}
+
+void otaCheckSoon() {
+  checkPending = true;
+}
+
+// The latest CIN of <first ae>/ota, read from Mobius over the TLS session
+static void checkLatest() {
+  checkPending = false;
+  if (!tankCount) return;
+  Tank& t = tanks[0];
+  String resp;
+  int code = m2mGet(t, cntPath(t, CNT_OTA) + "/la", resp);
+  if (code != 200) { Serial.printf("[OTA] latest: HTTP %d\n", code); return; }
+
+  StaticJsonDocument<1024> doc;
+  if (deserializeJson(doc, resp) != DeserializationError::Ok) return;
+  String con = doc["m2m:cin"]["con"].as<String>();
+  con.trim();
+  unescapeCon(con);
+  // Our own result CINs land here too; only CINs with a "url" start an update
+  if (con.indexOf("\"url\"") < 0) return;
+  otaRequest(t, con);
+}
+
+void otaService() {
+  switch (job.state) {
+    case OTA_IDLE:
+      if (checkPending) checkLatest();
+      return;
+    case OTA_HEADER: stepHeader(); break;
+    case OTA_BASE:   stepBase();   break;
+    case OTA_STREAM: stepStream(); break;
+    case OTA_REBOOT:
+      // Let the result report go out and any running pulse finish first
+      if (millis() - job.doneMs >= OTA_REBOOT_DELAY_MS && !anyPulseActive()) ESP.restart();
+      return;
+  }
+  if ((job.state == OTA_HEADER || job.state == OTA_STREAM) && millis() - job.lastDataMs > OTA_STALL_MS) {
+    otaFail("stalled");
+  }
+}
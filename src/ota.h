@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Streaming delta OTA
+// =========================
+// Triggered by a CIN in <first AE>/<CNT_OTA>:
+//   {"url":"http://<lan-host>:8000/fw.delta"}
+// A notification on that container is only a hint: the latest CIN is then
+// retrieved from Mobius over the TLS session, so a LAN host posting to the
+// notify server cannot choose the URL. The file (built with
+// tools/ota_delta.py) is
+//   "9PD2" | base size u32 | base sha256[32] | target size u32 | target sha256[32]
+//   | HMAC-SHA256(OTA_SIGN_KEY, the 76 bytes before it)[32]
+//   followed by a zlib stream of ops against the running partition:
+//   0x01 COPY off u32 len u32           bytes from the running image
+//   0x02 ADD  len u32 <len bytes>       literal bytes
+//   0x03 DIFF off u32 len u32 <len>     running image bytes + delta (mod 256)
+//   0x00 END
+// It is streamed from a plain HTTP server on the LAN, inflated with the ROM
+// inflater into a 32 KB window and written straight to the inactive OTA
+// partition; the image is never held in RAM. A header with a bad HMAC is
+// refused before anything is written. The target SHA-256 is updated as bytes
+// are produced and checked against the signed header before the new
+// partition is selected.
+// All work is done in slices from loop(), so notifications and pulses keep
+// being served while an update runs.
+
+// An OTA CIN was notified: retrieve <first ae>/ota/la on the next idle pass
+// and start the update it describes
+void otaCheckSoon();
+
+bool otaBusy();
+
+// Call every loop
+void otaService();
@@ -0,0 +1,177 @@
+#include "poller.h"
+#include "m2m_client.h"
+#include "scenes.h"
+#include "remote_config.h"
+#include <ArduinoJson.h>
+
+static unsigned long pollIntervalMs = POLL_INTERVAL_MS;
+static unsigned long lastPollSlot = 0;
+static uint8_t pollTank = 0;
+static uint8_t pollCh = 0;
+static uint8_t pollRound = 0;  // completed round-robin rounds (mod POLL_FULL_EVERY)
+
+// pollSoon() requests per tank: bit k = channel k, then "all" and "config"
+static const uint8_t SOON_ALL = MAX_CH_PER_TANK;
+static const uint8_t SOON_CONFIG = MAX_CH_PER_TANK + 1;
+static uint16_t soonMask[MAX_TANKS];
+
+// ct for the conditional retrieve of a container, "" for a full one
+static String sinceCt(const String& lastCt, bool full) {
+  return full || pollRound == 0 ? String() : lastCt;
+}
+
+// GET <cnt>/la -> con/ri/ct of the latest CIN. With since, the retrieve is
+// conditional (fu=2&cra=): the CSE returns the CIN only if it was created
+// after since and answers 404 (4004) otherwise, which means "unchanged" and
+// is not parsed.
+static bool fetchLatestCin(Tank& t, const char* cnt, const char* tag, String& con, Command& meta,
+                           const String& since = String()) {
+  String resp;
+  String path = cntPath(t, cnt) + "/la";
+  if (since.length()) path += "?fu=2&cra=" + since;
+  int code = m2mGet(t, path, resp);
+
+  if (since.length() && code == 404) return false; // nothing newer
+  if (code == 200) {
+    StaticJsonDocument<2048> doc;
+    if (deserializeJson(doc, resp) == DeserializationError::Ok) {
+      JsonVariant cin = doc["m2m:cin"];
+      if (!cin.isNull()) {
+        meta.ri = cin["ri"].as<String>();
+        meta.ct = cin["ct"].as<String>();
+        con = cin["con"].as<String>(); con.trim();
+        unescapeCon(con);
+        return true;
+      }
+      Serial.printf("[POLL][%s/%s] no m2m:cin in answer\n", t.ae, tag);
+    } else {
+      Serial.printf("[POLL][%s/%s] JSON parse error\n", t.ae, tag);
+    }
+    return false;
+  }
+  if (code == 404) { Serial.printf("[POLL][%s/%s] latest not found (404)\n", t.ae, tag); return false; }
+  Serial.printf("[POLL][%s/%s] HTTP %d\n", t.ae, tag, code);
+  if (resp.length()) Serial.println(resp);
+  return false;
+}
+
+bool fetchLatestAndDrive(Tank& t, Channel& c, bool full) {
+  String con;
+  Command cmd{false, SRC_POLL, "", ""};
+  if (!fetchLatestCin(t, c.cnt, c.name, con, cmd, sinceCt(c.lastCt, full))) return false;
+  if (!parseConToOnOff(con, cmd.on)) {
+    Serial.printf("[POLL][%s/%s] con parse fail: %s\n", t.ae, c.name, con.c_str());
+    return false;
+  }
+  applyCommand(t, c, cmd);
+  return true;
+}
+
+bool fetchLatestTankState(Tank& t, bool full) {
+  String con;
+  Command meta{false, SRC_POLL, "", ""};
+  if (!fetchLatestCin(t, CNT_ALL, CNT_ALL, con, meta, sinceCt(t.lastAllCt, full))) return false;
+  applyTankCon(t, con, meta);
+  return true;
+}
+
+bool fetchLatestConfig(Tank& t, bool full) {
+  String con;
+  Command meta{false, SRC_POLL, "", ""};
+  if (!fetchLatestCin(t, CNT_CONFIG, CNT_CONFIG, con, meta, sinceCt(t.lastCfgCt, full))) return false;
+  applyConfigCon(t, con, meta);
+  // Whatever the outcome (applied, same or older version, rejected), this
+  // CIN is done with
+  if (meta.ct.length()) t.lastCfgCt = meta.ct;
+  return true;
+}
+
+void pollSetInterval(unsigned long ms) {
+  pollIntervalMs = ms;
+}
+
+unsigned long pollInterval() {
+  return pollIntervalMs;
+}
+
+void pollAll() {
+  for (uint8_t i = 0; i < tankCount; i++) {
+    // configuration first, it can change the channel table
+    fetchLatestConfig(tanks[i]);
+    // channel CINs first, a newer whole-tank vector then overrides them by ct
+    for (uint8_t k = 0; k < tanks[i].nch; k++) fetchLatestAndDrive(tanks[i], tanks[i].ch[k]);
+    fetchLatestTankState(tanks[i]);
+  }
+  lastPollSlot = millis();
+}
+
+void pollSoon(Tank& t, const String& cnt) {
+  uint16_t& m = soonMask[&t - tanks];
+  if (cnt == CNT_ALL)    { m |= 1U << SOON_ALL; return; }
+  if (cnt == CNT_CONFIG) { m |= 1U << SOON_CONFIG; return; }
+  Channel* c = findChannel(t, cnt);
+  if (c) m |= 1U << (c - t.ch);
+}
+
+// One pending pollSoon() request, returns false if there is none. These
+// retrieves are unconditional: the CIN that was deferred is not necessarily
+// newer than the last one applied (same second), and the applied path
+// deduplicates by ri anyway.
+static bool serveSoon() {
+  for (uint8_t i = 0; i < tankCount; i++) {
+    uint16_t& m = soonMask[i];
+    if (!m) continue;
+    Tank& t = tanks[i];
+    // configuration first, it can change the channel table
+    if (m & (1U << SOON_CONFIG)) {
+      m &= ~(1U << SOON_CONFIG);
+      fetchLatestConfig(t, true);
+      return true;
+    }
+    for (uint8_t k = 0; k < t.nch; k++) {
+      if (!(m & (1U << k))) continue;
+      m &= ~(1U << k);
+      fetchLatestAndDrive(t, t.ch[k], true);
+      return true;
+    }
+    // channels first, a newer whole-tank vector then overrides them by ct
+    if (m & (1U << SOON_ALL)) fetchLatestTankState(t, true);
+    m = 0;
+    return true;
+  }
+  return false;
+}
+
+static uint16_t totalChannels() {
+  uint16_t n = 0;
+  for (uint8_t i = 0; i < tankCount; i++) n += tanks[i].nch + 2; // + "all", "config"
+  return n;
+}
+
+void pollService() {
+  if (serveSoon()) return;
+  uint16_t n = totalChannels();
+  if (n == 0) return;
+
+  unsigned long now = millis();
+  if (now - lastPollSlot < pollIntervalMs / n) return;
+  lastPollSlot = now;
+
+  // Round-robin over (tank, channel), slots nch and nch+1 are the tank's
+  // "all" and "config" containers
+  if (pollTank >= tankCount) { pollTank = 0; pollCh = 0; }
+  Tank& t = tanks[pollTank];
+  if (pollCh < t.nch) {
+    fetchLatestAndDrive(t, t.ch[pollCh++]);
+    return;
+  }
+  if (pollCh == t.nch) {
+    fetchLatestTankState(t);
+    pollCh++;
+    return;
+  }
+  fetchLatestConfig(t);
+  pollCh = 0;
+  pollTank = (pollTank + 1) % tankCount;
+  if (pollTank == 0) pollRound = (pollRound + 1) % POLL_FULL_EVERY;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "tank.h"
+
+// =========================
+// Polling (fallback for missed notifications)
+// =========================
+// One scheduler for all tanks: POLL_INTERVAL_MS is split into one slot per
+// channel (plus one each for the "all" and "config" containers of a tank),
+// so every channel is still polled once per interval but requests are spread
+// out instead of arriving in a burst. The interval can be changed at runtime.
+// Channel, "all" and "config" polls are conditional retrieves (fu=2) with
+// the ct of the last CIN seen as created-after filter (cra=): a newer CIN
+// comes back as usual, an unchanged container costs a short 404 and no
+// JSON parse.
+// Every POLL_FULL_EVERY-th round and the boot poll retrieve unconditionally.
+
+// Retrieve <cnt>/la and apply it through the normal command path
+// (full: unconditional retrieve, else conditional on all but full rounds)
+bool fetchLatestAndDrive(Tank& t, Channel& c, bool full = false);
+
+// Retrieve <ae>/all/la and apply the whole-tank vector (deduplicated by ri)
+bool fetchLatestTankState(Tank& t, bool full = false);
+
+// Retrieve <ae>/config/la and apply it if newer than the running config
+// (full as for fetchLatestAndDrive)
+bool fetchLatestConfig(Tank& t, bool full = false);
+
+// Retrieve a container's latest CIN (unconditionally) on the next loop
+// pass, ahead of the round robin; repeated calls before then cost nothing
+// more (cnt: a channel, CNT_ALL or CNT_CONFIG)
+void pollSoon(Tank& t, const String& cnt);
+
+// Poll every channel of every tank right now (used after boot)
+void pollAll();
+
+// Call every loop
+void pollService();
+
+// Runtime poll interval (remote config)
+void pollSetInterval(unsigned long ms);
+unsigned long pollInterval();
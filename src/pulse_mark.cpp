@@ -0,0 +1,140 @@
+#include "pulse_mark.h"
+#include "cse_time.h"
+#include <Preferences.h>
+#include <esp_attr.h>
+#include <esp_rom_crc.h>
+
+static const uint32_t MARK_MAGIC = 0x314B4D50; // "PMK1"
+
+struct Mark {
+  uint32_t key;     // hash of "<ae>/<cnt>", 0 = free slot
+  char ri[40];
+  char ct[16];
+};
+
+struct MarkSlot {
+  Mark m;
+  uint32_t crc;
+};
+
+struct MarkRtc {
+  uint32_t magic;
+  MarkSlot s[PULSE_MARK_SLOTS];
+};
+
+RTC_NOINIT_ATTR static MarkRtc rtcMarks;
+
+static bool nvsPending[PULSE_MARK_SLOTS];
+static unsigned long lastNvsMs = 0;
+static bool nvsWritten = false;
+
+static uint32_t markKey(const Tank& t, const Channel& c) {
+  return fnv1a(String(t.ae) + "/" + c.cnt);
+}
+
+static uint32_t markCrc(const Mark& m) {
+  return esp_rom_crc32_le(0, (const uint8_t*)&m, sizeof(m));
+}
+
+static void rtcCheck() {
+  if (rtcMarks.magic == MARK_MAGIC) return;
+  memset(&rtcMarks, 0, sizeof(rtcMarks));
+  rtcMarks.magic = MARK_MAGIC;
+}
+
+static String nvsKey(uint32_t key) {
+  char k[12];
+  snprintf(k, sizeof(k), "p%08lx", (unsigned long)key);
+  return k;
+}
+
+static void nvsWrite(const Mark& m) {
+  Preferences prefs;
+  prefs.begin("pmark", false);
+  prefs.putBytes(nvsKey(m.key).c_str(), &m, sizeof(m));
+  prefs.end();
+  lastNvsMs = millis();
+  nvsWritten = true;
+}
+
+// Slot of key: a valid one holding it, else a free (or corrupt) one. With
+// every slot taken by another channel the mark with the oldest ct goes; its
+// NVS copy is brought up to date first, so that channel keeps its mark
+// across a reset (from NVS instead of RTC).
+static int8_t slotOf(uint32_t key, bool create) {
+  int8_t freeSlot = -1, oldest = -1;
+  for (uint8_t i = 0; i < PULSE_MARK_SLOTS; i++) {
+    MarkSlot& s = rtcMarks.s[i];
+    bool valid = s.m.key && s.crc == markCrc(s.m);
+    if (valid && s.m.key == key) return i;
+    if (!valid && freeSlot < 0) freeSlot = i;
+    if (valid && (oldest < 0 || strcmp(s.m.ct, rtcMarks.s[oldest].m.ct) < 0)) oldest = i;
+  }
+  if (!create) return -1;
+  if (freeSlot >= 0) return freeSlot;
+
+  Mark& m = rtcMarks.s[oldest].m;
+  Serial.printf("[MARK] slots full, evicting %08lx (ri=%s ct=%s)\n", (unsigned long)m.key, m.ri, m.ct);
+  if (nvsPending[oldest]) {
+    nvsWrite(m);
+    nvsPending[oldest] = false;
+  }
+  return oldest;
+}
+
+void pulseMarkRestore(Tank& t) {
+  rtcCheck();
+  Preferences prefs;
+  bool open = false;
+  for (uint8_t k = 0; k < t.nch; k++) {
+    Channel& c = t.ch[k];
+    if (c.kind != CH_PULSE || c.lastRi.length()) continue;
+    uint32_t key = markKey(t, c);
+
+    Mark best = {};
+    int8_t i = slotOf(key, false);
+    if (i >= 0) best = rtcMarks.s[i].m;
+    if (!open) { prefs.begin("pmark", true); open = true; }
+    Mark nv = {};
+    if (prefs.getBytes(nvsKey(key).c_str(), &nv, sizeof(nv)) == sizeof(nv) && nv.key == key) {
+      nv.ri[sizeof(nv.ri) - 1] = nv.ct[sizeof(nv.ct) - 1] = 0;
+      if (!best.key || strcmp(nv.ct, best.ct) > 0) best = nv;
+    }
+    if (!best.key) continue;
+    c.lastRi = best.ri;
+    c.lastCt = best.ct;
+    Serial.printf("[MARK][%s/%s] last pulse ri=%s ct=%s\n", t.ae, c.name, best.ri, best.ct);
+  }
+  if (open) prefs.end();
+}
+
+void pulseMarkNote(const Tank& t, const Channel& c) {
+  rtcCheck();
+  Mark m = {};
+  m.key = markKey(t, c);
+  strlcpy(m.ri, c.lastRi.c_str(), sizeof(m.ri));
+  strlcpy(m.ct, c.lastCt.c_str(), sizeof(m.ct));
+
+  int8_t i = slotOf(m.key, true);
+  MarkSlot& s = rtcMarks.s[i];
+  if (memcmp(&s.m, &m, sizeof(m)) == 0 && s.crc == markCrc(m)) return; // unchanged
+  s.m = m;
+  s.crc = markCrc(m);
+
+  if (!nvsWritten || millis() - lastNvsMs >= PULSE_MARK_NVS_GAP_MS) {
+    nvsWrite(m);
+    nvsPending[i] = false;
+  } else {
+    nvsPending[i] = true;
+  }
+}
+
+void pulseMarkService() {
+  if (nvsWritten && millis() - lastNvsMs < PULSE_MARK_NVS_GAP_MS) return;
+  for (uint8_t i = 0; i < PULSE_MARK_SLOTS; i++) {
+    if (!nvsPending[i]) continue;
+    nvsPending[i] = false;
+    nvsWrite(rtcMarks.s[i].m);
+    return; // one write per gap
+  }
+}
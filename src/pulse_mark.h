@@ -0,0 +1,35 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Persistent pulse (feeder) watermark
+// =========================
+// The ri and ct of the last CIN that started a pulse are kept per pulse
+// channel, so a reboot or brownout does not feed again when the boot poll
+// (or a re-delivered notification) finds the same CIN: the restored
+// Channel::lastRi makes it a duplicate and Channel::lastCt makes anything
+// older stale, on every ingress path.
+//
+// Two copies, keyed by a hash of "<ae>/<cnt>":
+//   RTC_NOINIT memory  written on every pulse, survives resets but not power loss
+//   NVS ("pmark")      written only when the mark changed, and at most once per
+//                      PULSE_MARK_NVS_GAP_MS; a later change is flushed from
+//                      loop() once the gap has passed (the RTC copy covers a
+//                      reset in between)
+// At boot the newer of the two (by ct) is restored. RTC memory holds
+// PULSE_MARK_SLOTS marks; past that the oldest one is evicted from RTC only
+// (after its NVS copy is brought up to date).
+
+static const uint8_t PULSE_MARK_SLOTS = 8;
+static const unsigned long PULSE_MARK_NVS_GAP_MS = 60UL * 1000UL;
+
+// Restore the marks of the tank's pulse channels that have none yet
+// (after configInit, and after a remote config changed the table)
+void pulseMarkRestore(Tank& t);
+
+// A pulse was started from a command: store c.lastRi / c.lastCt
+void pulseMarkNote(const Tank& t, const Channel& c);
+
+// Deferred NVS writes, call every loop
+void pulseMarkService();
@@ -0,0 +1,248 @@
+#include "remote_config.h"
+#include "m2m_client.h"
+#include "poller.h"
+#include "pulse_mark.h"
+#include "cfg_image.h"
+#include "energy.h"
+#include "history.h"
+#include "latency.h"
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+
+static const unsigned long CFG_MIN_POLL_MS  = 1000;
+static const unsigned long CFG_MAX_PULSE_MS = 60UL * 1000UL;
+
+static String configPath(const Tank& t) {
+  return String("/cfg_") + t.ae + ".json";
+}
+
+// Output-capable GPIOs, without the flash pins (6-11), the console UART
+// (1, 3) and the strapping pins (0, 2, 12, 15) a relay could hold at the
+// wrong level during reset and stop the next boot
+static bool pinUsable(int pin) {
+  if (pin < 0 || pin > 33 || (pin >= 6 && pin <= 11)) return false;
+  return pin != 0 && pin != 1 && pin != 2 && pin != 3 && pin != 12 && pin != 15;
+}
+
+static bool pinUsedByOtherTank(const Tank& t, int pin) {
+  for (uint8_t i = 0; i < tankCount; i++) {
+    if (&tanks[i] == &t) continue;
+    for (uint8_t k = 0; k < tanks[i].nch; k++) if (tanks[i].ch[k].pin == pin) return true;
+  }
+  return false;
+}
+
+static unsigned long clampPulse(unsigned long ms) {
+  if (ms == 0) return FEED_PULSE_MS;
+  return ms > CFG_MAX_PULSE_MS ? CFG_MAX_PULSE_MS : ms;
+}
+
+// =========================
+// Persistence
+// =========================
+static void saveConfig(const Tank& t) {
+  DynamicJsonDocument doc(2048);
+  doc["v"] = t.cfgVersion;
+  if (&t == &tanks[0]) {
+    doc["poll_ms"] = pollInterval();
+    JsonArray eps = doc.createNestedArray("mobius");
+    for (uint8_t i = 0; i < m2mEndpointCount(); i++) eps.add(m2mEndpoint(i));
+  }
+  JsonArray arr = doc.createNestedArray("channels");
+  for (uint8_t k = 0; k < t.nch; k++) {
+    const Channel& c = t.ch[k];
+    JsonObject o = arr.createNestedObject();
+    o["cnt"] = c.cnt;
+    o["name"] = c.name;
+    o["pin"] = c.pin;
+    o["kind"] = c.kind == CH_PULSE ? "pulse" : "level";
+    if (c.watts) o["watts"] = c.watts;
+    if (c.kind == CH_PULSE) o["pulse_ms"] = c.pulseMs;
+  }
+
+  // Write-then-rename so a reset mid-write keeps the previous version
+  String path = configPath(t), tmp = path + ".tmp";
+  File f = LittleFS.open(tmp, "w");
+  if (!f) { Serial.printf("[CFG][%s] save failed\n", t.ae); return; }
+  serializeJson(doc, f);
+  f.close();
+  LittleFS.remove(path);
+  LittleFS.rename(tmp, path);
+}
+
+// =========================
+// Channel table diff
+// =========================
+static bool sameContainerSet(const Tank& t, const Channel* ch, uint8_t n) {
+  if (n != t.nch) return false;
+  for (uint8_t k = 0; k < n; k++) {
+    bool found = false;
+    for (uint8_t j = 0; j < t.nch && !found; j++) found = !strcmp(ch[k].cnt, t.ch[j].cnt);
+    if (!found) return false;
+  }
+  return true;
+}
+
+// Validates the whole table first, so a bad entry leaves the tank untouched
+static bool applyChannels(Tank& t, JsonArray arr, unsigned long defPulseMs) {
+  if (arr.size() > MAX_CH_PER_TANK) {
+    Serial.printf("[CFG][%s] too many channels (%u)\n", t.ae, (unsigned)arr.size());
+    return false;
+  }
+  uint8_t n = 0;
+  const char* cnts[MAX_CH_PER_TANK];
+  for (JsonObject o : arr) {
+    const char* cnt = o["cnt"] | "";
+    const char* name = o["name"] | cnt;
+    int pin = o["pin"] | -1;
+    if (!*cnt || strlen(cnt) >= sizeof(Channel::cnt) || strlen(name) >= sizeof(Channel::name) ||
+        !strcmp(cnt, CNT_ALL) || !strcmp(cnt, CNT_CONFIG) || !strcmp(cnt, CNT_OTA) ||
+        !strcmp(cnt, CNT_STATE)) {
+      Serial.printf("[CFG][%s] bad channel entry %u\n", t.ae, n);
+      return false;
+    }
+    if (!pinUsable(pin) || pinUsedByOtherTank(t, pin)) {
+      Serial.printf("[CFG][%s/%s] pin %d not available\n", t.ae, cnt, pin);
+      return false;
+    }
+    for (uint8_t j = 0; j < n; j++) {
+      if (!strcmp(cnts[j], cnt) || (arr[j]["pin"] | -1) == pin) {
+        Serial.printf("[CFG][%s/%s] duplicate cnt or pin\n", t.ae, cnt);
+        return false;
+      }
+    }
+    cnts[n++] = cnt;
+  }
+
+  // Build the new table, carrying over channels that did not move
+  Channel next[MAX_CH_PER_TANK];
+  bool carried[MAX_CH_PER_TANK] = {};
+  uint8_t k = 0;
+  for (JsonObject o : arr) {
+    const char* cnt = o["cnt"];
+    const char* name = o["name"] | cnt;
+    int pin = o["pin"];
+    ChannelKind kind = strcmp(o["kind"] | "level", "pulse") ? CH_LEVEL : CH_PULSE;
+    unsigned long pulseMs = clampPulse(o["pulse_ms"] | defPulseMs);
+
+    Channel* old = findChannel(t, cnt);
+    uint16_t watts = o["watts"] | (old ? old->watts : (uint16_t)0);
+    Channel& c = next[k++];
+    if (old && old->pin == pin && old->kind == kind) {
+      c = *old;
+      carried[old - t.ch] = true;
+      strlcpy(c.name, name, sizeof(c.name));
+      c.pulseMs = pulseMs;
+      c.watts = watts;
+      continue;
+    }
+    // New or moved channel: it is set up after the old pins are released
+    strlcpy(c.cnt, cnt, sizeof(c.cnt));
+    strlcpy(c.name, name, sizeof(c.name));
+    c.pin = pin;
+    c.kind = kind;
+    c.pulseMs = pulseMs;
+    c.watts = watts;
+    c.lastRi = old ? old->lastRi : String();
+  }
+
+  for (uint8_t j = 0; j < t.nch; j++) {
+    if (carried[j]) continue;
+    Serial.printf("[CFG][%s/%s] released pin %d\n", t.ae, t.ch[j].name, t.ch[j].pin);
+    channelRelease(t.ch[j]);
+  }
+  for (uint8_t j = 0; j < n; j++) {
+    Channel* old = findChannel(t, next[j].cnt);
+    if (old && carried[old - t.ch]) continue;
+    String ri = next[j].lastRi;
+    uint16_t watts = next[j].watts;
+    channelInit(next[j], next[j].cnt, next[j].name, next[j].pin, next[j].kind, next[j].pulseMs);
+    next[j].lastRi = ri;
+    next[j].watts = watts;
+    Serial.printf("[CFG][%s/%s] pin %d\n", t.ae, next[j].name, next[j].pin);
+  }
+
+  if (!sameContainerSet(t, next, n)) t.subsDirty = true;
+  energySync(t);  // credit on-time so far at the old wattage
+  for (uint8_t j = 0; j < n; j++) t.ch[j] = next[j];
+  t.nch = n;
+  energyTableChanged(t);
+  historyTableChanged(t);
+  latencyTableChanged(t);
+  pulseMarkRestore(t); // pulse channels new to the table
+  return true;
+}
+
+// =========================
+// Apply
+// =========================
+CmdResult applyConfigCon(Tank& t, const String& con, const Command& meta) {
+  DynamicJsonDocument doc(2048);
+  if (deserializeJson(doc, con) != DeserializationError::Ok || !doc.is<JsonObject>()) {
+    Serial.printf("[CFG][%s] con parse fail\n", t.ae);
+    return CMD_IGNORED;
+  }
+  uint32_t v = doc["v"] | 0;
+  if (v == t.cfgVersion) return CMD_DUP;
+  if (v < t.cfgVersion) {
+    Serial.printf("[%s][%s] config v%u older than v%u\n", srcTag(meta.src), t.ae, v, t.cfgVersion);
+    return CMD_STALE;
+  }
+
+  unsigned long defPulseMs = clampPulse(doc["pulse_ms"] | 0UL);
+  if (doc.containsKey("channels")) {
+    if (!applyChannels(t, doc["channels"].as<JsonArray>(), defPulseMs)) return CMD_IGNORED;
+  } else if (doc.containsKey("pulse_ms")) {
+    for (uint8_t k = 0; k < t.nch; k++) t.ch[k].pulseMs = defPulseMs;
+  }
+
+  // Device-wide settings belong to the first AE
+  if (&t == &tanks[0]) {
+    unsigned long pollMs = doc["poll_ms"] | 0UL;
+    if (pollMs >= CFG_MIN_POLL_MS && pollMs != pollInterval()) {
+      pollSetInterval(pollMs);
+      Serial.printf("[CFG] poll interval %lums\n", pollMs);
+    }
+    String bases[M2M_MAX_ENDPOINTS];
+    uint8_t nb = 0;
+    JsonVariant mob = doc["mobius"];
+    if (mob.is<JsonArray>()) {
+      for (JsonVariant b : mob.as<JsonArray>()) {
+        const char* url = b | "";
+        if (nb < M2M_MAX_ENDPOINTS && *url) bases[nb++] = url;
+      }
+    } else if (*(mob | "")) {
+      bases[nb++] = mob.as<const char*>();
+    }
+    bool changed = nb && nb != m2mEndpointCount();
+    for (uint8_t i = 0; nb && !changed && i < nb; i++) changed = bases[i] != m2mEndpoint(i);
+    if (changed) {
+      m2mSetEndpoints(bases, nb);
+      for (uint8_t i = 0; i < tankCount; i++) tanks[i].subsDirty = true;
+      Serial.printf("[CFG] mobius %s (+%u)\n", bases[0].c_str(), nb - 1);
+    }
+  }
+
+  t.cfgVersion = v;
+  if (meta.src != SRC_BOOT) saveConfig(t); // already what is stored
+  Serial.printf("[%s][%s] config v%u applied\n", srcTag(meta.src), t.ae, v);
+  return CMD_APPLIED;
+}
+
+void configInit() {
+  for (uint8_t i = 0; i < tankCount; i++) {
+    String con;
+    File f = LittleFS.open(configPath(tanks[i]), "r");
+    if (f) {
+      con = f.readString();
+      f.close();
+    } else {
+      // No remote config yet: base config from the read-only image, if any
+      const char* data;
+      size_t len;
+      if (!cfgBlob("config", tanks[i].ae, data, len)) continue;
+      con.concat(data, len);
+    }
+    applyConfigCon(tanks[i], con, Command{false, SRC_BOOT, "", ""});
+  }
+}
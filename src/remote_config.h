@@ -0,0 +1,33 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Remote configuration ("config" container)
+// =========================
+// con of a CIN in <ae>/config:
+//   {"v":3,
+//    "poll_ms":20000,                        device-wide, first AE only
+//    "mobius":["https://10.0.0.5:443",       device-wide, first AE only; ordered
+//              "https://10.0.0.6:443"],      endpoint list (a plain string is one)
+//    "pulse_ms":2500,                        default width of pulse channels
+//    "channels":[{"cnt":"LED","name":"LED","pin":25,"kind":"level","watts":24},
+//                {"cnt":"feed","name":"FEEDER","pin":26,"kind":"pulse","pulse_ms":1500}]}
+// pin must be an output GPIO that is not a flash, UART or strapping pin.
+// Every key is optional. A notification on the container is not applied
+// itself; it makes the poller retrieve config/la from the CSE. A CIN is
+// applied only if v is newer than the running version. It is diffed
+// against the running configuration and only what changed is touched,
+// without a reboot:
+//   - a channel with the same cnt and pin keeps its relay state and history
+//   - a channel that moved to another pin starts off on the new pin
+//   - a channel missing from "channels" is switched off and its pin released
+//   - if the set of containers changed, the tank is resubscribed from loop()
+// The merged running configuration is stored as /cfg_<ae>.json and loaded
+// again at boot, before the network comes up. Until the first remote config
+// arrives, the "config" entry of the read-only image (cfg_image.h) is used.
+
+// Load the stored configuration of every tank (after tanksInit and LittleFS)
+void configInit();
+
+CmdResult applyConfigCon(Tank& t, const String& con, const Command& meta);
@@ -0,0 +1,134 @@
+#include "scenes.h"
+#include "cfg_image.h"
+#include "history.h"
+#include "cse_time.h"
+#include <LittleFS.h>
+
+static String scenePath(const Tank& t) {
+  return String("/scenes_") + t.ae + ".json";
+}
+
+static bool parseStateValue(JsonVariant v, bool& on) {
+  if (v.is<bool>()) { on = v.as<bool>(); return true; }
+  if (v.is<int>())  { on = v.as<int>() != 0; return true; }
+  if (v.is<const char*>()) return parseConToOnOff(v.as<String>(), on);
+  return false;
+}
+
+// State vector -> channel mask/levels, skipping channels that already
+// applied a newer command
+static bool vectorToMask(Tank& t, JsonObject states, const Command& meta,
+                         uint32_t& mask, uint32_t& levels) {
+  mask = levels = 0;
+  for (JsonPair kv : states) {
+    Channel* c = findChannel(t, kv.key().c_str());
+    bool on = false;
+    if (!c || !parseStateValue(kv.value(), on)) {
+      Serial.printf("[ALL][%s] bad entry: %s\n", t.ae, kv.key().c_str());
+      return false;
+    }
+    if (meta.ct.length() && c->lastCt.length() && meta.ct < c->lastCt) {
+      historyAppend(t, *c, meta, CMD_STALE);
+      continue;
+    }
+    // A whole-tank CIN that already pulsed this channel (e.g. before a reboot)
+    if (c->kind == CH_PULSE && meta.ri.length() && meta.ri == c->lastRi) {
+      historyAppend(t, *c, meta, CMD_DUP);
+      continue;
+    }
+    uint32_t bit = 1UL << (c - t.ch);
+    mask |= bit;
+    if (on) levels |= bit;
+  }
+  return true;
+}
+
+static CmdResult commitVector(Tank& t, JsonObject states, const Command& meta) {
+  uint32_t mask, levels;
+  if (!vectorToMask(t, states, meta, mask, levels)) return CMD_IGNORED;
+  if (!mask) return CMD_STALE;
+  commitRelays(t, mask, levels, meta);
+  return CMD_APPLIED;
+}
+
+// =========================
+// Scenes (LittleFS)
+// =========================
+static bool loadScenes(const Tank& t, JsonDocument& doc) {
+  File f = LittleFS.open(scenePath(t), "r");
+  if (!f) return false;
+  DeserializationError err = deserializeJson(doc, f);
+  f.close();
+  return err == DeserializationError::Ok;
+}
+
+bool sceneSave(Tank& t, const String& id, JsonVariant states) {
+  DynamicJsonDocument doc(4096);
+  if (!loadScenes(t, doc)) doc.to<JsonObject>();
+  doc[id] = states;
+  if (doc.overflowed()) { Serial.printf("[SCENE][%s] table full\n", t.ae); return false; }
+
+  // Write-then-rename so a reset mid-write keeps the old table
+  String path = scenePath(t), tmp = path + ".tmp";
+  File f = LittleFS.open(tmp, "w");
+  if (!f) return false;
+  serializeJson(doc, f);
+  f.close();
+  LittleFS.remove(path);
+  bool ok = LittleFS.rename(tmp, path);
+  Serial.printf("[SCENE][%s] saved %s (%d)\n", t.ae, id.c_str(), ok);
+  return ok;
+}
+
+// Scene from the read-only image, parsed straight from mapped flash
+static bool loadImageScene(const Tank& t, const String& id, JsonDocument& doc) {
+  String key = String(t.ae) + "/" + id;
+  const char* data;
+  size_t len;
+  if (!cfgBlob("scene", key.c_str(), data, len)) return false;
+  return deserializeJson(doc, data, len) == DeserializationError::Ok && doc.is<JsonObject>();
+}
+
+bool sceneApply(Tank& t, const String& id, const Command& meta) {
+  DynamicJsonDocument doc(4096);
+  JsonObject states;
+  if (loadScenes(t, doc) && doc[id].is<JsonObject>()) {
+    states = doc[id].as<JsonObject>();
+  } else if (loadImageScene(t, id, doc)) {
+    states = doc.as<JsonObject>();
+  } else {
+    Serial.printf("[SCENE][%s] unknown scene: %s\n", t.ae, id.c_str());
+    return false;
+  }
+  Command cmd = meta;
+  cmd.src = SRC_SCENE;
+  if (!cmd.ct.length()) cmd.ct = ctNow();
+  Serial.printf("[SCENE][%s] %s\n", t.ae, id.c_str());
+  return commitVector(t, states, cmd) == CMD_APPLIED;
+}
+
+// =========================
+// "all" container
+// =========================
+CmdResult applyTankCon(Tank& t, const String& con, const Command& meta) {
+  if (meta.ri.length() && meta.ri == t.lastAllRi) return CMD_DUP;
+
+  DynamicJsonDocument doc(1024);
+  if (deserializeJson(doc, con) != DeserializationError::Ok || !doc.is<JsonObject>()) {
+    Serial.printf("[%s][%s/all] con parse fail: %s\n", srcTag(meta.src), t.ae, con.c_str());
+    return CMD_IGNORED;
+  }
+
+  CmdResult r;
+  if (doc["save"].is<const char*>()) {
+    r = sceneSave(t, doc["save"].as<String>(), doc["set"]) ? CMD_APPLIED : CMD_IGNORED;
+  } else if (doc["scene"].is<const char*>()) {
+    r = sceneApply(t, doc["scene"].as<String>(), meta) ? CMD_APPLIED : CMD_IGNORED;
+  } else {
+    JsonObject states = doc["set"].is<JsonObject>() ? doc["set"].as<JsonObject>() : doc.as<JsonObject>();
+    r = commitVector(t, states, meta);
+  }
+  if (meta.ri.length()) t.lastAllRi = meta.ri;
+  if (meta.ct.length()) t.lastAllCt = meta.ct;
+  return r;
+}
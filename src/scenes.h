@@ -0,0 +1,23 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "tank.h"
+
+// =========================
+// Whole-tank commands ("all" container) and on-device scenes
+// =========================
+// con of a CIN in <ae>/all:
+//   {"LED":"on","heater":0,"pump":true}   state vector keyed by container
+//   {"set":{ ...state vector... }}        same, explicit form
+//   {"scene":"night"}                     apply a scene stored on the device
+//   {"save":"night","set":{ ... }}        store (or replace) a scene, no apply
+// Channels missing from the vector keep their state. The vector is applied
+// with one commitRelays() call, so the tank switches in one step.
+// Scenes live in LittleFS as /scenes_<ae>.json ({"<id>":{...vector...}}).
+// Scenes not found there are looked up in the read-only config image
+// (cfg_image.h), which can hold large preset tables without using RAM.
+
+CmdResult applyTankCon(Tank& t, const String& con, const Command& meta);
+
+bool sceneApply(Tank& t, const String& id, const Command& meta);
+bool sceneSave(Tank& t, const String& id, JsonVariant states);
@@ -0,0 +1,87 @@
+#include "state_report.h"
+#include "journal.h"
+#include <sys/time.h>
+
+struct Transition {
+  unsigned long atMs; // millis() of the edge
+  uint8_t ch;
+  bool on;
+};
+
+struct ReportQueue {
+  Transition tr[STATE_BATCH_MAX];
+  uint8_t n;
+  unsigned long firstMs;   // first queued edge of the burst
+  unsigned long lastMs;    // latest queued edge
+  unsigned long retryAtMs; // != 0 while backing off after a failure
+  uint32_t dropped;
+};
+
+static ReportQueue queues[MAX_TANKS];
+
+void reportTransition(Tank& t, uint8_t ch, bool on) {
+  ReportQueue& q = queues[&t - tanks];
+  unsigned long now = millis();
+  if (q.n == STATE_BATCH_MAX) {
+    // Keep the newest edges, the bitmask still carries the final state
+    memmove(&q.tr[0], &q.tr[1], sizeof(Transition) * (STATE_BATCH_MAX - 1));
+    q.n--;
+    q.dropped++;
+  }
+  if (q.n == 0) q.firstMs = now;
+  q.tr[q.n++] = Transition{now, ch, on};
+  q.lastMs = now;
+}
+
+static uint32_t relayMask(const Tank& t) {
+  uint32_t m = 0;
+  for (uint8_t k = 0; k < t.nch; k++) if (t.ch[k].on) m |= 1UL << k;
+  return m;
+}
+
+static bool flushQueue(Tank& t, ReportQueue& q) {
+  // Edge times are millis(); anchor them to wall clock at flush time
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  unsigned long nowMs = millis();
+  int64_t baseEpochMs = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - (int64_t)(nowMs - q.firstMs);
+  uint32_t baseSec = (uint32_t)(baseEpochMs / 1000);
+  uint32_t baseRemMs = (uint32_t)(baseEpochMs % 1000);
+
+  String con = "{\"m\":" + String(relayMask(t)) + ",\"b\":" + String(baseSec) + ",\"tr\":[";
+  for (uint8_t i = 0; i < q.n; i++) {
+    if (i) con += ",";
+    con += "[" + String(q.tr[i].ch) + "," + String(q.tr[i].on ? 1 : 0) + "," +
+           String(baseRemMs + (q.tr[i].atMs - q.firstMs)) + "]";
+  }
+  con += "]";
+  if (q.dropped) con += ",\"drop\":" + String(q.dropped);
+  con += "}";
+
+  // Posted now, or kept in the journal until Mobius is reachable again
+  bool ok = outboxPostCin(t, CNT_STATE, con);
+  Serial.printf("[REPORT][%s] %u edges -> %s\n", t.ae, q.n, ok ? "ok" : "failed");
+  if (!ok) return false;
+
+  q.n = 0;
+  q.dropped = 0;
+  return true;
+}
+
+void reportService() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < tankCount; i++) {
+    ReportQueue& q = queues[i];
+    if (q.n == 0) continue;
+
+    bool quiet   = now - q.lastMs  >= REPORT_DEBOUNCE_MS;
+    bool overdue = now - q.firstMs >= REPORT_MAX_DELAY_MS;
+    if (!quiet && !overdue) continue;
+    if (q.retryAtMs && (long)(now - q.retryAtMs) < 0) continue;
+    if (anyPulseActive()) return; // never stall a pulse end behind TLS
+
+    if (flushQueue(tanks[i], q)) q.retryAtMs = 0;
+    else                         q.retryAtMs = now + REPORT_RETRY_MS;
+    return; // at most one request per loop pass
+  }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Actuator state reporting (device -> Mobius)
+// =========================
+// Every real relay transition is queued in RAM (O(1), no I/O) and the queue
+// of a tank is posted as one CIN to <ae>/<CNT_STATE> once the burst is over:
+//   {"m":<relay bitmask>,"b":<base epoch s>,"tr":[[ch,on,ms after b],...]}
+// ch is the channel index of the tank's table. Posting runs from loop() on
+// the shared Mobius client (through the journal outbox, so reports survive
+// outages) and is held back while a pulse is running, so a slow request never
+// delays a relay edge.
+
+static const uint8_t STATE_BATCH_MAX = 16;
+
+// Called by the relay layer on every level change
+void reportTransition(Tank& t, uint8_t ch, bool on);
+
+// Call every loop
+void reportService();
@@ -0,0 +1,303 @@
+#include "subscriptions.h"
+#include "m2m_client.h"
+#include "notify.h"
+#include <ArduinoJson.h>
+#include <time.h>
+
+// Per tank renewal schedule, validation cursor over all tanks
+struct SubSched {
+  unsigned long renewAtMs;
+  uint8_t renewNext;    // next sub to renew, 0 = not renewing
+  bool scheduled;
+};
+static SubSched sched[MAX_TANKS];
+static uint8_t checkTank = 0, checkSub = 0;
+static unsigned long lastCheckMs = 0;
+
+// ",\"et\":\"<now + lifetime>\"" or "" while the clock is not set
+// (the CSE default applies until the first renewal)
+static String etField() {
+  time_t now = time(nullptr);
+  if (now < 1700000000) return "";
+  now += SUB_LIFETIME_S;
+  struct tm tmv;
+  gmtime_r(&now, &tmv);
+  char buf[20];
+  strftime(buf, sizeof(buf), "%Y%m%dT%H%M%S", &tmv);
+  return String(",\"et\":\"") + buf + "\"";
+}
+
+// Subscription body shared by the per-channel and the group (fopt) path
+static String subBody(const String& rn, const String& nu) {
+  return String("{\"m2m:sub\":{") +
+         "\"rn\":\"" + rn + "\"," +
+         "\"enc\":{\"net\":[3]}," +      // Create child CIN event
+         "\"nct\":2," +                  // whole resource
+         "\"pn\":1,\"ln\":true," +        // after an outage: the latest one only
+         "\"nu\":[\"" + nu + "\"]" +
+         etField() +
+         "}}";
+}
+
+// nu + et update of an existing subscription (also moves subs created by
+// older firmware to the latest-only policy)
+static String subUpdateBody(const String& nu) {
+  return String("{\"m2m:sub\":{\"nu\":[\"") + nu + "\"],\"pn\":1,\"ln\":true" + etField() + "}}";
+}
+
+// Subscriptions of a tank in a fixed order; group mode has one, the fan-out
+// path, which reaches the sub under every member
+static uint8_t subCount(const Tank& t) {
+  if (USE_GROUP_SUBSCRIPTION) return 1;
+  return t.nch + 2 + (&t == &tanks[0] ? 1 : 0);
+}
+
+static const char* subCnt(const Tank& t, uint8_t k) {
+  if (k < t.nch) return t.ch[k].cnt;
+  return k == t.nch ? CNT_ALL : k == t.nch + 1 ? CNT_CONFIG : CNT_OTA;
+}
+
+static String subPath(const Tank& t, uint8_t k) {
+  if (USE_GROUP_SUBSCRIPTION) return aePath(t) + "/" + GRP_CTRL_RN + "/fopt/" + SUB_CTRL_RN;
+  if (k < t.nch) return cntPath(t, t.ch[k].cnt) + "/" + subNameOf(t.ch[k]);
+  return cntPath(t, subCnt(t, k)) + "/sub_" + subCnt(t, k);
+}
+
+static String subNu(const Tank& t, uint8_t k) {
+  return USE_GROUP_SUBSCRIPTION ? notifyUrl(t) : notifyUrl(t, subCnt(t, k));
+}
+
+bool createSubscription(Tank& t, const char* cnt, const String& rn) {
+  String nu = notifyUrl(t, cnt);
+  String target = cntPath(t, cnt);
+  Serial.printf("[SUB] %-6s -> POST %s (nu=%s)\n", cnt, target.c_str(), nu.c_str());
+
+  String resp;
+  int code = m2mPost(t, target, 23, subBody(rn, nu), resp);
+
+  Serial.printf("[SUB] %-6s -> HTTP %d\n", cnt, code);
+  if (resp.length()) Serial.printf("[SUB] Resp: %s\n", resp.c_str());
+
+  if (code == 201) return true;        // Created
+  if (code == 409) {                   // Already exists —> Correct nu, refresh et
+    Serial.printf("[SUB] Already exists (409): %s\n", rn.c_str());
+    // Re-assert both in one round trip instead of reading the sub first
+    String ur;
+    int uc = m2mPut(t, target + "/" + rn, subUpdateBody(nu), ur);
+    Serial.printf("[SUB][PUT] %s -> HTTP %d\n", rn.c_str(), uc);
+    if (uc != 200 && ur.length()) Serial.println(ur);
+    return uc == 200;
+  }
+  return false;
+}
+
+// =========================
+// Group fan-out subscription
+// =========================
+// Counts member results of an aggregated fopt response (m2m:agr/m2m:rsp[].rsc)
+static void countFanout(const String& resp, int& ok, int& exists, int& failed) {
+  ok = exists = failed = 0;
+  DynamicJsonDocument doc(4096);
+  if (deserializeJson(doc, resp) != DeserializationError::Ok) return;
+  JsonVariant agr = doc["m2m:agr"];
+  JsonVariant rsp = agr["m2m:rsp"];
+  if (rsp.isNull()) rsp = agr["rsp"];
+  for (JsonVariant r : rsp.as<JsonArray>()) {
+    int rsc = r["rsc"] | 0;
+    if (rsc == 2000 || rsc == 2001 || rsc == 2004) ok++;
+    else if (rsc == 4105) exists++;
+    else failed++;
+  }
+}
+
+static bool ensureGroup(Tank& t) {
+  String mid;
+  for (uint8_t k = 0; k < t.nch; k++) {
+    if (k) mid += ",";
+    mid += "\"" + cntPath(t, t.ch[k].cnt) + "\"";
+  }
+  mid += ",\"" + cntPath(t, CNT_ALL) + "\"";
+  mid += ",\"" + cntPath(t, CNT_CONFIG) + "\"";
+  if (&t == &tanks[0]) mid += ",\"" + cntPath(t, CNT_OTA) + "\"";
+
+  String body = String("{\"m2m:grp\":{") +
+                "\"rn\":\"" + GRP_CTRL_RN + "\"," +
+                "\"mt\":3," +                   // members are containers
+                "\"mnm\":" + String(MAX_CH_PER_TANK + 3) + "," +
+                "\"mid\":[" + mid + "]" +
+                "}}";
+  String resp;
+  int code = m2mPost(t, aePath(t), 9, body, resp);
+  Serial.printf("[GRP] %s/%s -> HTTP %d\n", t.ae, GRP_CTRL_RN, code);
+  if (code == 201) return true;
+  if (code == 409) {
+    // Already exists: re-assert the member list in one round trip
+    String ur;
+    int uc = m2mPut(t, aePath(t) + "/" + GRP_CTRL_RN, String("{\"m2m:grp\":{\"mid\":[") + mid + "]}}", ur);
+    Serial.printf("[GRP][PUT] mid -> HTTP %d\n", uc);
+    return uc == 200;
+  }
+  if (resp.length()) Serial.printf("[GRP] Resp: %s\n", resp.c_str());
+  return false;
+}
+
+bool createGroupSubscription(Tank& t) {
+  if (!ensureGroup(t)) return false;
+
+  String nu = notifyUrl(t);
+  String fopt = aePath(t) + "/" + GRP_CTRL_RN + "/fopt";
+  Serial.printf("[SUB] %s -> POST %s (nu=%s)\n", t.ae, fopt.c_str(), nu.c_str());
+
+  String resp;
+  int code = m2mPost(t, fopt, 23, subBody(SUB_CTRL_RN, nu), resp);
+  int ok, exists, failed;
+  countFanout(resp, ok, exists, failed);
+  Serial.printf("[SUB] fopt -> HTTP %d (created=%d exists=%d failed=%d)\n", code, ok, exists, failed);
+  if (code < 200 || code >= 300) {
+    if (resp.length()) Serial.printf("[SUB] Resp: %s\n", resp.c_str());
+    return false;
+  }
+
+  if (exists > 0) {
+    // Some members already carry sub_ctrl: point them all at our nu with one fan-out PUT
+    String ur;
+    int uc = m2mPut(t, fopt + "/" + SUB_CTRL_RN, subUpdateBody(nu), ur);
+    int pok, pexists, pfailed;
+    countFanout(ur, pok, pexists, pfailed);
+    Serial.printf("[SUB][PUT] fopt/%s -> HTTP %d (updated=%d failed=%d)\n", SUB_CTRL_RN, uc, pok, pfailed);
+    failed += pfailed;
+  }
+  return failed == 0;
+}
+
+// =========================
+// Renewal and validation
+// =========================
+// Renewal at SUB_RENEW_PCT of the lifetime, minus a per-tank offset that
+// spreads the tanks over half of the remaining margin
+static void scheduleRenewal(const Tank& t) {
+  uint8_t i = &t - tanks;
+  uint64_t lifeMs = (uint64_t)SUB_LIFETIME_S * 1000ULL;
+  uint64_t spreadMs = lifeMs * (100 - SUB_RENEW_PCT) / 200;
+  uint64_t delayMs = lifeMs * SUB_RENEW_PCT / 100 - spreadMs * i / MAX_TANKS;
+  sched[i].renewAtMs = millis() + (unsigned long)delayMs;
+  sched[i].renewNext = 0;
+  sched[i].scheduled = true;
+}
+
+// Result of a renewal PUT or validation GET of sub k. A sub that is gone
+// (404, or failed fan-out members) makes the tank dirty, so it is recreated
+// on the next pass. Returns false on a transport error (try again later).
+static bool subStillThere(Tank& t, uint8_t k, const char* what, int code, const String& resp) {
+  bool lost = code == 404;
+  if (USE_GROUP_SUBSCRIPTION && code >= 200 && code < 300) {
+    int ok, exists, failed;
+    countFanout(resp, ok, exists, failed);
+    lost = failed > 0;
+  }
+  if (lost) {
+    Serial.printf("[SUB] %s %s: lost on the CSE (HTTP %d), resubscribing\n",
+                  what, subPath(t, k).c_str(), code);
+    t.subsDirty = true;
+    return true;
+  }
+  if (code < 200 || code >= 300) {
+    Serial.printf("[SUB] %s %s -> HTTP %d\n", what, subPath(t, k).c_str(), code);
+    return code >= 400 && code < 500;
+  }
+  return true;
+}
+
+// One step of a tank's renewal. Returns true if a request was made.
+static bool renewStep(Tank& t) {
+  SubSched& s = sched[&t - tanks];
+  if (t.subsDirty || !s.scheduled || (long)(millis() - s.renewAtMs) < 0) return false;
+  uint8_t k = s.renewNext;
+  String resp;
+  int code = m2mPut(t, subPath(t, k), subUpdateBody(subNu(t, k)), resp);
+  if (!subStillThere(t, k, "renew", code, resp)) {
+    s.renewAtMs = millis() + 30000UL; // transport error: same sub again later
+    return true;
+  }
+  if (t.subsDirty) { s.scheduled = false; return true; } // redone (and rescheduled) as a whole
+  if (++s.renewNext >= subCount(t)) {
+    Serial.printf("[SUB] %s: %u subscription(s) renewed\n", t.ae, subCount(t));
+    scheduleRenewal(t);
+  }
+  return true;
+}
+
+// Next subscription of the round robin; one full cycle per SUB_CHECK_MS
+static void validateStep() {
+  uint16_t total = 0;
+  for (uint8_t i = 0; i < tankCount; i++) total += subCount(tanks[i]);
+  if (!total || millis() - lastCheckMs < SUB_CHECK_MS / total) return;
+  lastCheckMs = millis();
+
+  if (checkTank >= tankCount) { checkTank = 0; checkSub = 0; }
+  Tank& t = tanks[checkTank];
+  if (checkSub >= subCount(t)) checkSub = 0;
+  uint8_t k = checkSub;
+  if (++checkSub >= subCount(t)) { checkSub = 0; checkTank = (checkTank + 1) % tankCount; }
+  if (t.subsDirty) return;
+
+  String resp;
+  int code = m2mGet(t, subPath(t, k), resp);
+  subStillThere(t, k, "check", code, resp);
+}
+
+bool subscribeTank(Tank& t) {
+  if (USE_GROUP_SUBSCRIPTION) {
+    bool ok = createGroupSubscription(t);
+    Serial.printf("[SUB RESULT] %s: grp=%d\n", t.ae, ok);
+    t.subsDirty = !ok;
+    if (ok) scheduleRenewal(t);
+    return ok;
+  }
+  String result;
+  bool all = true;
+  for (uint8_t k = 0; k < t.nch; k++) {
+    bool ok = createSubscription(t, t.ch[k].cnt, subNameOf(t.ch[k]));
+    all &= ok;
+    String tag = t.ch[k].name; tag.toLowerCase();
+    result += " " + tag + "=" + String(ok ? 1 : 0);
+  }
+  bool okAll = createSubscription(t, CNT_ALL, String("sub_") + CNT_ALL);
+  result += String(" all=") + String(okAll ? 1 : 0);
+  all &= okAll;
+  bool okCfg = createSubscription(t, CNT_CONFIG, String("sub_") + CNT_CONFIG);
+  result += String(" config=") + String(okCfg ? 1 : 0);
+  all &= okCfg;
+  if (&t == &tanks[0]) {
+    bool okOta = createSubscription(t, CNT_OTA, String("sub_") + CNT_OTA);
+    result += String(" ota=") + String(okOta ? 1 : 0);
+    all &= okOta;
+  }
+  Serial.printf("[SUB RESULT] %s:%s\n", t.ae, result.c_str());
+  t.subsDirty = !all;
+  if (all) scheduleRenewal(t);
+  return all;
+}
+
+void subscribeAll() {
+  // failed tanks stay dirty and are retried by subscriptionService()
+  for (uint8_t i = 0; i < tankCount; i++) subscribeTank(tanks[i]);
+}
+
+void subscriptionService() {
+  static const unsigned long SUB_RETRY_MS = 30UL * 1000UL;
+  static unsigned long lastTryMs = 0;
+  if (anyPulseActive() || m2mCircuitOpen()) return;
+  for (uint8_t i = 0; i < tankCount; i++) {
+    if (!tanks[i].subsDirty) continue;
+    // a changed table is redone at once, failures are retried with spacing
+    if (lastTryMs && millis() - lastTryMs < SUB_RETRY_MS) break;
+    lastTryMs = millis();
+    if (subscribeTank(tanks[i])) lastTryMs = 0;
+    return;
+  }
+  for (uint8_t i = 0; i < tankCount; i++) {
+    if (renewStep(tanks[i])) return;
+  }
+  validateStep();
+}
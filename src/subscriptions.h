@@ -0,0 +1,25 @@
+#pragma once
+#include "tank.h"
+
+// =========================
+// Create Subscription and auto-correct nu
+// =========================
+bool createSubscription(Tank& t, const char* cnt, const String& rn);
+
+// Group fan-out: <grp> over all control containers of the tank plus one
+// subscription created through <grp>/fopt (USE_GROUP_SUBSCRIPTION)
+bool createGroupSubscription(Tank& t);
+
+// Subscribe one tank (group or per channel), logs one result line.
+// Success schedules the tank's next renewal.
+bool subscribeTank(Tank& t);
+
+// Subscribe every tank
+void subscribeAll();
+
+// Background subscription upkeep, call every loop. At most one request per
+// pass, in this order:
+//   - redo tanks whose container set changed or whose subscription was lost
+//   - renew the et of a tank that reached its renewal time (one sub per pass)
+//   - validate the next subscription in a round robin over all tanks
+void subscriptionService();
@@ -0,0 +1,278 @@
+#include "tank.h"
+#include <ArduinoJson.h>
+#include "soc/gpio_reg.h"
+#include "state_report.h"
+#include "events.h"
+#include "history.h"
+#include "tseries.h"
+#include "energy.h"
+#include "flight_rec.h"
+#include "latency.h"
+#include "pulse_mark.h"
+#include "lan_api.h"
+
+static portMUX_TYPE relayMux = portMUX_INITIALIZER_UNLOCKED;
+
+Tank tanks[MAX_TANKS];
+uint8_t tankCount = 0;
+
+void tanksInit() {
+  tankCount = 0;
+  for (size_t i = 0; i < sizeof(AE_TABLE) / sizeof(AE_TABLE[0]) && tankCount < MAX_TANKS; i++) {
+    const AeConfig& cfg = AE_TABLE[i];
+    Tank& t = tanks[tankCount++];
+    strlcpy(t.ae, cfg.ae, sizeof(t.ae));
+    t.origin = cfg.origin;
+    t.nch = 0;
+    t.cfgVersion = 0;
+    t.subsDirty = false;
+    for (uint8_t k = 0; k < cfg.nch && t.nch < MAX_CH_PER_TANK; k++) {
+      const ChannelConfig& cc = cfg.ch[k];
+      channelInit(t.ch[t.nch], cc.cnt, cc.name, cc.pin, cc.kind, FEED_PULSE_MS);
+      t.ch[t.nch++].watts = cc.watts;
+    }
+    Serial.printf("[TANK] %s: %u channels (origin=%s)\n", t.ae, t.nch, t.origin.c_str());
+  }
+}
+
+void channelInit(Channel& c, const char* cnt, const char* name, int pin,
+                 ChannelKind kind, unsigned long pulseMs) {
+  strlcpy(c.cnt,  cnt,  sizeof(c.cnt));
+  strlcpy(c.name, name, sizeof(c.name));
+  c.pin = pin;
+  c.kind = kind;
+  c.pulseMs = pulseMs;
+  c.watts = 0;
+  c.on = false;
+  c.pulseActive = false;
+  c.pulseEndMs = 0;
+  c.lastRi = "";
+  c.lastCt = "";
+
+  // Reset Relay to Safe State
+  pinMode(c.pin, OUTPUT);
+  relayWritePin(c.pin, false);
+}
+
+void channelRelease(Channel& c) {
+  relayWritePin(c.pin, false);
+  pinMode(c.pin, INPUT);
+}
+
+Tank* findTank(const String& ae) {
+  for (uint8_t i = 0; i < tankCount; i++) {
+    if (ae == tanks[i].ae) return &tanks[i];
+  }
+  return nullptr;
+}
+
+Channel* findChannel(Tank& t, const String& cnt) {
+  for (uint8_t i = 0; i < t.nch; i++) {
+    if (cnt == t.ch[i].cnt) return &t.ch[i];
+  }
+  return nullptr;
+}
+
+String subNameOf(const Channel& c) {
+  String rn = String("sub_") + c.name;
+  rn.toLowerCase();
+  return rn;
+}
+
+const char* srcTag(CmdSource src) {
+  switch (src) {
+    case SRC_NOTIFY: return "NOTIFY";
+    case SRC_POLL:   return "POLL";
+    case SRC_SCENE:  return "SCENE";
+    case SRC_LAN:    return "LAN";
+    case SRC_UDP:    return "UDP";
+    case SRC_TIMER:  return "TIMER";
+    case SRC_BOOT:   return "BOOT";
+  }
+  return "?";
+}
+
+// =========================
+// con Parser
+// =========================
+void unescapeCon(String& con) {
+  if (con.indexOf("\\\"") >= 0) {
+    String un = con;
+    un.replace("\\\"", "\"");
+    un.replace("\\\\", "\\");
+    if (un.startsWith("{") && un.endsWith("}")) con = un;
+  }
+}
+
+bool parseConToOnOff(const String& con, bool& outOn) {
+  String s = con; s.trim();
+  if (s.equalsIgnoreCase("on")  || s == "1") { outOn = true;  return true; }
+  if (s.equalsIgnoreCase("off") || s == "0") { outOn = false; return true; }
+
+  if (s.length() > 0 && s[0] == '{') {
+    StaticJsonDocument<256> d;
+    if (deserializeJson(d, s) == DeserializationError::Ok) {
+      if (d.containsKey("cmd")) {
+        const char* cmd = d["cmd"];
+        if (cmd) {
+          if (!strcasecmp(cmd, "on"))  { outOn = true;  return true; }
+          if (!strcasecmp(cmd, "off")) { outOn = false; return true; }
+        }
+      }
+      if (d.containsKey("on")) {
+        if (d["on"].is<bool>()) { outOn = d["on"].as<bool>(); return true; }
+        if (d["on"].is<int>())  { outOn = d["on"].as<int>() != 0; return true; }
+        if (d["on"].is<const char*>()) {
+          const char* v = d["on"];
+          if (!strcasecmp(v, "on"))  { outOn = true;  return true; }
+          if (!strcasecmp(v, "off")) { outOn = false; return true; }
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// =========================
+// Relay / Pulse State Machine
+// =========================
+// Bookkeeping for every level change, whichever path drove the pin
+static void noteLevel(Tank& t, Channel& c, bool on, CmdSource src) {
+  if (c.on == on) return;
+  c.on = on;
+  frNote(FR_RELAY, (&t - tanks) << 4 | (&c - t.ch), on);
+  reportTransition(t, &c - t.ch, on);
+  eventPublish(t, &c - t.ch, on, src);
+  tsAppend(t, &c - t.ch, on);
+  energyTransition(t, &c - t.ch, on);
+}
+
+static void setRelay(Tank& t, Channel& c, bool on, CmdSource src) {
+  relayWritePin(c.pin, on);
+  noteLevel(t, c, on, src);
+}
+
+static void armPulse(Channel& c) {
+  c.pulseActive = true;
+  c.pulseEndMs = millis() + c.pulseMs;
+  Serial.printf("[%s] PULSE START (%lums)\n", c.name, c.pulseMs);
+}
+
+static void startPulse(Tank& t, Channel& c, CmdSource src) {
+  // If pulse is already active, leave it as is, otherwise start new pulse
+  if (!c.pulseActive) {
+    setRelay(t, c, true, src); // ON
+    armPulse(c);
+  }
+}
+
+void commitRelays(Tank& t, uint32_t mask, uint32_t levels, const Command& cmd) {
+  uint32_t set0 = 0, clr0 = 0, set1 = 0, clr1 = 0;
+  for (uint8_t k = 0; k < t.nch; k++) {
+    if (!(mask & (1UL << k))) continue;
+    Channel& c = t.ch[k];
+    bool on = levels & (1UL << k);
+    if (c.kind == CH_PULSE && (!on || c.pulseActive)) continue; // off ignored, running pulse kept
+    bool high = RELAY_ACTIVE_LOW ? !on : on;
+    if (c.pin < 32) (high ? set0 : clr0) |= 1UL << c.pin;
+    else            (high ? set1 : clr1) |= 1UL << (c.pin - 32);
+  }
+
+  portENTER_CRITICAL(&relayMux);
+  REG_WRITE(GPIO_OUT_W1TS_REG,  set0);
+  REG_WRITE(GPIO_OUT_W1TC_REG,  clr0);
+  REG_WRITE(GPIO_OUT1_W1TS_REG, set1);
+  REG_WRITE(GPIO_OUT1_W1TC_REG, clr1);
+  portEXIT_CRITICAL(&relayMux);
+
+  for (uint8_t k = 0; k < t.nch; k++) {
+    if (!(mask & (1UL << k))) continue;
+    Channel& c = t.ch[k];
+    bool on = levels & (1UL << k);
+    CmdResult r = CMD_APPLIED;
+    if (c.kind == CH_PULSE) {
+      if (on && !c.pulseActive) { noteLevel(t, c, true, cmd.src); armPulse(c); }
+      else r = CMD_IGNORED;
+    } else {
+      noteLevel(t, c, on, cmd.src);
+    }
+    if (cmd.ct.length()) c.lastCt = cmd.ct;
+    if (c.kind == CH_PULSE && r == CMD_APPLIED) {
+      if (cmd.ri.length()) c.lastRi = cmd.ri;
+      pulseMarkNote(t, c);
+    }
+    historyAppend(t, c, cmd, r);
+    if (r == CMD_APPLIED) latencyRecord(t, c, cmd);
+  }
+  Serial.printf("[%s][%s] COMMIT mask=0x%02lx levels=0x%02lx (ri=%s)\n",
+                srcTag(cmd.src), t.ae, (unsigned long)mask, (unsigned long)(levels & mask), cmd.ri.c_str());
+}
+
+void pulseService() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < tankCount; i++) {
+    Tank& t = tanks[i];
+    for (uint8_t k = 0; k < t.nch; k++) {
+      Channel& c = t.ch[k];
+      if (c.pulseActive && (long)(now - c.pulseEndMs) >= 0) {
+        setRelay(t, c, false, SRC_TIMER); // OFF
+        c.pulseActive = false;
+        Serial.printf("[%s] PULSE END\n", c.name);
+      }
+    }
+  }
+}
+
+bool anyPulseActive() {
+  for (uint8_t i = 0; i < tankCount; i++)
+    for (uint8_t k = 0; k < tanks[i].nch; k++)
+      if (tanks[i].ch[k].pulseActive) return true;
+  return false;
+}
+
+static CmdResult applyToChannel(Tank& t, Channel& c, const Command& cmd) {
+  // A whole-tank CIN newer than this one already set the channel
+  // (ct is fixed-width "YYYYMMDDTHHMMSS", so string order is time order)
+  if (cmd.ct.length() && c.lastCt.length() && cmd.ct < c.lastCt) {
+    Serial.printf("[%s][%s/%s] stale (ct=%s < %s)\n", srcTag(cmd.src), t.ae, c.name,
+                  cmd.ct.c_str(), c.lastCt.c_str());
+    return CMD_STALE;
+  }
+  // Our own LAN mirror coming back: the relay is already there, and a later
+  // LAN command in the same second would otherwise be undone (equal ct)
+  if (lanIsMirrorEcho(cmd.ri)) {
+    if (cmd.ct.length()) c.lastCt = cmd.ct;
+    Serial.printf("[%s][%s/%s] own mirror (ri=%s)\n", srcTag(cmd.src), t.ae, c.name, cmd.ri.c_str());
+    return CMD_DUP;
+  }
+
+  if (c.kind == CH_PULSE) {
+    // on means pulse, off means ignored + ri duplicate prevention. Either
+    // way the CIN is handled, so its ct moves the conditional poll on (as
+    // in commitRelays).
+    if (cmd.ct.length()) c.lastCt = cmd.ct;
+    if (cmd.ri.length() && cmd.ri == c.lastRi) return CMD_DUP;
+    if (!cmd.on) {
+      Serial.printf("[%s][%s/%s] ignored(off)\n", srcTag(cmd.src), t.ae, c.name);
+      return CMD_IGNORED;
+    }
+    // A LAN/UDP pulse has no ri and must not clear the cloud watermark
+    if (cmd.ri.length()) c.lastRi = cmd.ri;
+    startPulse(t, c, cmd.src);
+    pulseMarkNote(t, c);
+    Serial.printf("[%s][%s/%s] TRIGGER (ri=%s)\n", srcTag(cmd.src), t.ae, c.name, cmd.ri.c_str());
+    return CMD_APPLIED;
+  }
+
+  setRelay(t, c, cmd.on, cmd.src);
+  if (cmd.ct.length()) c.lastCt = cmd.ct;
+  Serial.printf("[%s][%s/%s] %s\n", srcTag(cmd.src), t.ae, c.name, cmd.on ? "ON" : "OFF");
+  return CMD_APPLIED;
+}
+
+CmdResult applyCommand(Tank& t, Channel& c, const Command& cmd) {
+  CmdResult r = applyToChannel(t, c, cmd);
+  historyAppend(t, c, cmd, r);
+  if (r == CMD_APPLIED) latencyRecord(t, c, cmd);
+  return r;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <Arduino.h>
+#include "app_config.h"
+
+// =========================
+// Tank (AE) contexts and relay channels
+// =========================
+static const uint8_t MAX_TANKS       = 4;
+static const uint8_t MAX_CH_PER_TANK = 8;
+
+enum CmdSource : uint8_t {
+  SRC_NOTIFY, SRC_POLL, SRC_SCENE, SRC_LAN, SRC_UDP,
+  SRC_TIMER,  // end of a pulse (no ingress)
+  SRC_BOOT    // stored/local configuration loaded at boot
+};
+
+enum CmdResult : uint8_t {
+  CMD_APPLIED, // relay driven (or pulse started)
+  CMD_DUP,     // same CIN already processed
+  CMD_IGNORED, // pulse channel: "off" has no effect
+  CMD_STALE    // older than the command already applied to the channel
+};
+
+// One command as it arrives from any ingress
+struct Command {
+  bool on;
+  CmdSource src;
+  String ri;  // CIN resource id ("" if unknown)
+  String ct;  // CIN creation time "YYYYMMDDTHHMMSS" ("" if unknown)
+};
+
+struct Channel {
+  char cnt[24];   // container name
+  char name[12];  // log tag
+  int pin;
+  ChannelKind kind;
+  unsigned long pulseMs;    // CH_PULSE width
+  uint16_t watts;           // load when on, 0 = unknown
+
+  bool on;                  // last level written to the relay
+  bool pulseActive;
+  unsigned long pulseEndMs;
+  String lastRi;            // Prevent duplicate pulse triggers
+  String lastCt;            // ct of the last applied command (orders "all" vs channel CINs)
+};
+
+struct Tank {
+  char ae[32];
+  String origin;            // X-M2M-Origin for this AE
+  Channel ch[MAX_CH_PER_TANK];
+  uint8_t nch;
+  String lastAllRi;         // last whole-tank CIN applied from the "all" container
+  String lastAllCt;         // its ct (conditional retrieve of all/la)
+  uint32_t cfgVersion;      // version of the applied remote config (0 = built-in)
+  String lastCfgCt;         // ct of the last config CIN retrieved (conditional retrieve of config/la)
+  bool subsDirty;           // container set changed, subscriptions must be redone
+};
+
+extern Tank tanks[MAX_TANKS];
+extern uint8_t tankCount;
+
+inline void relayWritePin(int pin, bool on) {
+  int level = RELAY_ACTIVE_LOW ? (on ? LOW : HIGH) : (on ? HIGH : LOW);
+  digitalWrite(pin, level);
+}
+
+// Load AE_TABLE and reset every relay to the safe (off) state
+void tanksInit();
+
+// Fresh channel in the safe state (pin configured as output, relay off)
+void channelInit(Channel& c, const char* cnt, const char* name, int pin,
+                 ChannelKind kind, unsigned long pulseMs);
+
+// Release a channel's pin: relay off, pin back to input
+void channelRelease(Channel& c);
+
+Tank* findTank(const String& ae);
+Channel* findChannel(Tank& t, const String& cnt);
+String subNameOf(const Channel& c);
+
+// con parsing ("on"/"off"/"1"/"0"/{"cmd":..}/{"on":..})
+bool parseConToOnOff(const String& con, bool& outOn);
+void unescapeCon(String& con);
+
+// Single command path for every ingress (notify, poll)
+CmdResult applyCommand(Tank& t, Channel& c, const Command& cmd);
+
+// Whole-tank commit: every channel whose bit is set in mask is driven to its
+// bit in levels with one GPIO register write per bank, so the tank never
+// passes through intermediate states. Pulse channels start their pulse.
+void commitRelays(Tank& t, uint32_t mask, uint32_t levels, const Command& cmd);
+
+// FEEDER-style pulse state machine, call every loop
+void pulseService();
+
+// Background network work waits while this is true so pulse ends stay on time
+bool anyPulseActive();
+
+const char* srcTag(CmdSource src);
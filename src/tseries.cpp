@@ -0,0 +1,304 @@
+#include "tseries.h"
+#include "notify.h"
+#include "lan_api.h"
+#include <LittleFS.h>
+#include <sys/time.h>
+
+static const char* const TS_DIR = "/ts";
+static const size_t TS_HDR = 12;
+static const uint8_t TS_VERSION = 1;
+
+static uint32_t firstBlk = 0, headBlk = 0;   // oldest / current block number
+static bool any = false;                      // at least one block on flash
+static bool headOpen = false;                 // current block started this boot
+static uint32_t baseSec[TS_MAX_BLOCKS];       // time index, by block % TS_MAX_BLOCKS
+static uint32_t headSize = 0;                 // bytes of headBlk on flash
+static uint64_t lastDs = 0;                   // time of the last record, 0.1 s
+static uint32_t relayState = 0;
+
+static uint8_t buf[256];
+static size_t blen = 0;
+static unsigned long bufSinceMs = 0;
+
+static String blkPath(uint32_t n) {
+  return String(TS_DIR) + "/" + String(n) + ".blk";
+}
+
+static uint64_t nowDs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (uint64_t)tv.tv_sec * 10 + tv.tv_usec / 100000;
+}
+
+static void handleRange();
+static void handleDuty();
+
+void tsInit() {
+  server.on("/ts", HTTP_GET, handleRange);
+  server.on("/ts/duty", HTTP_GET, handleDuty);
+
+  if (!LittleFS.exists(TS_DIR)) LittleFS.mkdir(TS_DIR);
+  File dir = LittleFS.open(TS_DIR);
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    String name = f.name();
+    name = name.substring(name.lastIndexOf('/') + 1);
+    if (!name.endsWith(".blk")) continue;
+    uint32_t n = (uint32_t)name.toInt();
+    if (!any || n < firstBlk) firstBlk = n;
+    if (!any || n > headBlk) headBlk = n;
+    any = true;
+  }
+  if (!any) { Serial.println("[TS] empty"); return; }
+
+  // Time index from the block headers
+  if (headBlk - firstBlk >= TS_MAX_BLOCKS) firstBlk = headBlk - TS_MAX_BLOCKS + 1;
+  for (uint32_t n = firstBlk; n <= headBlk; n++) {
+    uint8_t hdr[TS_HDR] = {};
+    File f = LittleFS.open(blkPath(n), "r");
+    if (f) { f.read(hdr, TS_HDR); f.close(); }
+    memcpy(&baseSec[n % TS_MAX_BLOCKS], hdr + 4, 4);
+  }
+  Serial.printf("[TS] blocks %u..%u\n", firstBlk, headBlk);
+}
+
+// =========================
+// Append
+// =========================
+static void flushBuf() {
+  if (!blen) return;
+  File f = LittleFS.open(blkPath(headBlk), "a");
+  if (!f) { Serial.println("[TS] open for append failed"); blen = 0; return; }
+  headSize += f.write(buf, blen);
+  f.close();
+  blen = 0;
+}
+
+static void startBlock(uint32_t sec) {
+  flushBuf();
+  if (any) headBlk++;
+  if (!any) firstBlk = headBlk;
+  any = true;
+  headOpen = true;
+  headSize = 0;
+  while (headBlk - firstBlk >= TS_MAX_BLOCKS) LittleFS.remove(blkPath(firstBlk++));
+
+  baseSec[headBlk % TS_MAX_BLOCKS] = sec;
+  lastDs = (uint64_t)sec * 10;
+  buf[0] = 'T'; buf[1] = 'S'; buf[2] = TS_VERSION; buf[3] = 0;
+  memcpy(buf + 4, &sec, 4);
+  memcpy(buf + 8, &relayState, 4);
+  blen = TS_HDR;
+  bufSinceMs = millis();
+}
+
+void tsAppend(const Tank& t, uint8_t ch, bool on) {
+  uint8_t tank = &t - tanks;
+  uint32_t bit = 1UL << (tank * MAX_CH_PER_TANK + ch);
+  uint64_t now = nowDs();
+  if (now < 17000000000ULL) { relayState = on ? relayState | bit : relayState & ~bit; return; }
+
+  if (!headOpen || headSize + blen + 6 > TS_BLOCK_BYTES) startBlock((uint32_t)(now / 10));
+  if (blen + 6 > sizeof(buf)) flushBuf();
+  if (!blen) bufSinceMs = millis();
+
+  uint64_t dt = now > lastDs ? now - lastDs : 0;
+  lastDs = now;
+  do {
+    uint8_t b = dt & 0x7F;
+    dt >>= 7;
+    buf[blen++] = dt ? (b | 0x80) : b;
+  } while (dt);
+  buf[blen++] = (uint8_t)(tank << 4 | ch << 1 | (on ? 1 : 0));
+  relayState = on ? relayState | bit : relayState & ~bit;
+}
+
+void tsService() {
+  if (blen && millis() - bufSinceMs >= TS_FLUSH_MS && !anyPulseActive()) flushBuf();
+}
+
+// =========================
+// Query
+// =========================
+struct BlockReader {
+  File f;
+  uint8_t b[128];
+  size_t len = 0, pos = 0;
+
+  int next() {
+    if (pos >= len) {
+      len = f.read(b, sizeof(b));
+      pos = 0;
+      if (len == 0 || len > sizeof(b)) return -1;
+    }
+    return b[pos++];
+  }
+};
+
+// Visits every record with time in [fromDs, toDs]; visit gets the relay state
+// before the record. Returns false if the visitor stopped early.
+typedef bool (*TsVisit)(uint64_t ds, uint8_t code, uint32_t stateBefore, void* ctx);
+
+// Last block whose base time is <= sec (first block if none)
+static uint32_t findBlock(uint32_t sec) {
+  uint32_t lo = firstBlk, hi = headBlk;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (baseSec[mid % TS_MAX_BLOCKS] <= sec) lo = mid; else hi = mid - 1;
+  }
+  return lo;
+}
+
+static bool scan(uint64_t fromDs, uint64_t toDs, TsVisit visit, void* ctx, uint32_t& stateAtFrom) {
+  stateAtFrom = 0;
+  if (!any) return true;
+  flushBuf();
+  bool first = true;
+  for (uint32_t n = findBlock((uint32_t)(fromDs / 10)); n <= headBlk; n++) {
+    if ((uint64_t)baseSec[n % TS_MAX_BLOCKS] * 10 > toDs) break;
+    BlockReader r;
+    r.f = LittleFS.open(blkPath(n), "r");
+    if (!r.f) continue;
+    uint8_t hdr[TS_HDR];
+    if (r.f.read(hdr, TS_HDR) != TS_HDR || hdr[0] != 'T' || hdr[1] != 'S') { r.f.close(); continue; }
+    uint32_t sec, state;
+    memcpy(&sec, hdr + 4, 4);
+    memcpy(&state, hdr + 8, 4);
+    if (first) { stateAtFrom = state; first = false; }
+    uint64_t ds = (uint64_t)sec * 10;
+
+    while (true) {
+      uint64_t dt = 0;
+      int c, shift = 0;
+      while ((c = r.next()) >= 0) {
+        dt |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+        if (!(c & 0x80) || shift > 56) break;
+      }
+      int code = c >= 0 ? r.next() : -1;
+      if (code < 0) break;
+      ds += dt;
+      uint32_t bit = 1UL << ((code >> 4) * MAX_CH_PER_TANK + ((code >> 1) & 7));
+      if (ds < fromDs) {
+        state = (code & 1) ? state | bit : state & ~bit;
+        stateAtFrom = state;
+        continue;
+      }
+      if (ds > toDs) { r.f.close(); return true; }
+      if (!visit(ds, (uint8_t)code, state, ctx)) { r.f.close(); return false; }
+      state = (code & 1) ? state | bit : state & ~bit;
+    }
+    r.f.close();
+  }
+  return true;
+}
+
+struct RawCtx { String* out; uint16_t n, max; };
+
+static bool visitRaw(uint64_t ds, uint8_t code, uint32_t, void* p) {
+  RawCtx& c = *(RawCtx*)p;
+  if (c.n >= c.max) return false;
+  char row[48];
+  snprintf(row, sizeof(row), "%s[%llu,%u,%u,%u]", c.n ? "," : "", (unsigned long long)ds,
+           code >> 4, (code >> 1) & 7, code & 1);
+  *c.out += row;
+  c.n++;
+  return true;
+}
+
+static bool rangeArgs(uint64_t& fromDs, uint64_t& toDs) {
+  if (!server.hasArg("from")) return false;
+  fromDs = (uint64_t)server.arg("from").toInt() * 10;
+  toDs = server.hasArg("to") ? (uint64_t)server.arg("to").toInt() * 10 : nowDs();
+  return toDs >= fromDs;
+}
+
+static void handleRange() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  uint64_t fromDs, toDs;
+  if (!rangeArgs(fromDs, toDs)) { server.send(400, "text/plain", "from/to"); return; }
+  long max = server.hasArg("n") ? server.arg("n").toInt() : 500;
+
+  String body = "{\"tr\":[";
+  RawCtx ctx{ &body, 0, (uint16_t)(max < 1 ? 1 : (max > 2000 ? 2000 : max)) };
+  uint32_t state;
+  bool complete = scan(fromDs, toDs, visitRaw, &ctx, state);
+  body += String("],\"more\":") + (complete ? "0" : "1") + "}";
+  server.send(200, "application/json", body);
+}
+
+struct DutyCtx {
+  uint32_t bit;
+  uint64_t fromDs, stepDs;
+  uint16_t buckets;
+  bool started;           // state at "from" known
+  bool on;
+  uint64_t sinceDs;       // start of the current on period
+  uint32_t onDs[TS_MAX_BUCKETS];
+};
+
+// Adds [a, b) of on-time to the buckets it spans
+static void addOn(DutyCtx& c, uint64_t a, uint64_t b) {
+  while (a < b) {
+    uint32_t k = (a - c.fromDs) / c.stepDs;
+    if (k >= c.buckets) return;
+    uint64_t end = c.fromDs + (uint64_t)(k + 1) * c.stepDs;
+    uint64_t e = b < end ? b : end;
+    c.onDs[k] += e - a;
+    a = e;
+  }
+}
+
+static bool visitDuty(uint64_t ds, uint8_t code, uint32_t stateBefore, void* p) {
+  DutyCtx& c = *(DutyCtx*)p;
+  if (!c.started) {
+    c.started = true;
+    c.on = stateBefore & c.bit;
+    c.sinceDs = c.fromDs;
+  }
+  uint32_t bit = 1UL << ((code >> 4) * MAX_CH_PER_TANK + ((code >> 1) & 7));
+  if (bit != c.bit) return true;
+  bool on = code & 1;
+  if (on && !c.on) c.sinceDs = ds;
+  if (!on && c.on) addOn(c, c.sinceDs, ds);
+  c.on = on;
+  return true;
+}
+
+static void handleDuty() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  Tank* t = findTank(server.arg("ae"));
+  if (!t && !server.hasArg("ae") && tankCount) t = &tanks[0];
+  Channel* c = t ? findChannel(*t, server.arg("ch")) : nullptr;
+  if (!c) { server.send(404, "text/plain", "unknown channel"); return; }
+  uint64_t fromDs, toDs;
+  if (!rangeArgs(fromDs, toDs)) { server.send(400, "text/plain", "from/to"); return; }
+  long step = server.hasArg("step") ? server.arg("step").toInt() : 3600;
+  if (step < 1) step = 1;
+
+  static DutyCtx ctx;  // ~1 KB, kept off the loop task stack
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.bit = 1UL << ((t - tanks) * MAX_CH_PER_TANK + (c - t->ch));
+  ctx.fromDs = fromDs;
+  ctx.stepDs = (uint64_t)step * 10;
+  uint64_t n = (toDs - fromDs + ctx.stepDs - 1) / ctx.stepDs;
+  ctx.buckets = n > TS_MAX_BUCKETS ? TS_MAX_BUCKETS : (n ? n : 1);
+  uint64_t endDs = fromDs + ctx.buckets * ctx.stepDs;
+  if (endDs > toDs) endDs = toDs;
+
+  uint32_t state;
+  scan(fromDs, endDs, visitDuty, &ctx, state);
+  if (!ctx.started) {
+    // no transition in range: the level at "from" held throughout
+    ctx.on = state & ctx.bit;
+    ctx.sinceDs = fromDs;
+  }
+  if (ctx.on) addOn(ctx, ctx.sinceDs, endDs);
+
+  String body = "{\"step\":" + String(step) + ",\"from\":" + String((uint32_t)(fromDs / 10)) + ",\"d\":[";
+  for (uint16_t k = 0; k < ctx.buckets; k++) {
+    if (k) body += ",";
+    body += String((uint32_t)((uint64_t)ctx.onDs[k] * 1000 / ctx.stepDs));
+  }
+  body += "]}";
+  server.send(200, "application/json", body);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// On-flash time series of relay transitions (LittleFS)
+// =========================
+// Append-only, in /ts/<n>.blk blocks of at most TS_BLOCK_BYTES, at most
+// TS_MAX_BLOCKS of them (the oldest is removed). A block is
+//   header  "TS" | version u8 | 0 u8 | base epoch s u32 | relay state u32
+//   records varint(time since previous record, 0.1 s) | code u8
+//           code = tank << 4 | channel << 1 | on
+// so a transition costs 2-4 bytes. The header state (bit tank*8+channel)
+// lets a query start at any block without replaying older ones, and the
+// base times form the time index: the RAM copy of it is rebuilt from the
+// block headers at boot, and a range query binary-searches it and only
+// reads the blocks that overlap.
+// Records collect in RAM and are appended every TS_FLUSH_MS (or when the
+// buffer fills). A new block is started at boot, with all relays off.
+// Nothing is recorded before the clock is synced.
+//
+//   GET /ts?from=<s>&to=<s>[&n=<max>]           raw transitions
+//       -> {"tr":[[t*10,tank,ch,on],...],"more":0|1}
+//   GET /ts/duty?ae=&ch=&from=<s>&to=<s>&step=<s>   downsampled
+//       -> {"step":s,"from":s,"d":[on-time per bucket in permille,...]}
+// (LAN token required)
+
+static const uint16_t TS_BLOCK_BYTES = 4096;
+static const uint8_t TS_MAX_BLOCKS = 64;
+static const unsigned long TS_FLUSH_MS = 60UL * 1000UL;
+static const uint16_t TS_MAX_BUCKETS = 288;
+
+void tsInit();
+
+// Called by the relay layer on every level change (RAM only)
+void tsAppend(const Tank& t, uint8_t ch, bool on);
+
+// Flushes the RAM buffer by age, call every loop
+void tsService();
@@ -0,0 +1,163 @@
+#include "udp_control.h"
+#include "lan_api.h"
+#include "cse_time.h"
+#include <lwip/sockets.h>
+#include <mbedtls/md.h>
+#include <time.h>
+
+static const size_t UDP_FRAME = 44;
+static const size_t UDP_SIGNED = 28;
+static const size_t UDP_MAC = 16;
+static const uint8_t UDP_VERSION = 2;
+
+enum UdpResult : uint8_t { UDP_OK = 0, UDP_OLD_SEQ = 1, UDP_NO_TANK = 2, UDP_TIME = 3, UDP_BOOT = 4 };
+
+static int sock = -1;
+static mbedtls_md_context_t hmac;
+static uint8_t rx[64];
+static uint8_t tx[UDP_FRAME];
+static uint32_t bootNonce;
+static uint64_t lastSeq[MAX_TANKS];
+static Command cmd{false, SRC_UDP, "", ""};  // reused, keeps its ct buffer
+static UdpStats stats;
+
+static uint32_t rd32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t rd64(const uint8_t* p) {
+  return (uint64_t)rd32(p) | ((uint64_t)rd32(p + 4) << 32);
+}
+
+static void wr32(uint8_t* p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void wr64(uint8_t* p, uint64_t v) {
+  wr32(p, (uint32_t)v);
+  wr32(p + 4, (uint32_t)(v >> 32));
+}
+
+static void mac(const uint8_t* data, uint8_t* out) {
+  uint8_t full[32];
+  mbedtls_md_hmac_reset(&hmac);
+  mbedtls_md_hmac_update(&hmac, data, UDP_SIGNED);
+  mbedtls_md_hmac_finish(&hmac, full);
+  memcpy(out, full, UDP_MAC);
+}
+
+static bool macOk(const uint8_t* frame) {
+  uint8_t want[UDP_MAC];
+  mac(frame, want);
+  uint8_t diff = 0;
+  for (size_t i = 0; i < UDP_MAC; i++) diff |= want[i] ^ frame[UDP_SIGNED + i];
+  return diff == 0;
+}
+
+void udpControlInit() {
+  if (!UDP_CONTROL_PORT) return;
+  do bootNonce = esp_random(); while (!bootNonce);
+  mbedtls_md_init(&hmac);
+  if (mbedtls_md_setup(&hmac, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0 ||
+      mbedtls_md_hmac_starts(&hmac, (const uint8_t*)UDP_CONTROL_KEY, strlen(UDP_CONTROL_KEY)) != 0) {
+    Serial.println("[UDP] hmac setup failed");
+    return;
+  }
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(UDP_CONTROL_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    Serial.println("[UDP] bind failed");
+    if (sock >= 0) close(sock);
+    sock = -1;
+    return;
+  }
+  fcntl(sock, F_SETFL, O_NONBLOCK);
+  Serial.printf("[UDP] control on :%u\n", UDP_CONTROL_PORT);
+}
+
+// =========================
+// Frame handling
+// =========================
+static void sendAck(const struct sockaddr_in& to, uint8_t tank, uint64_t seq,
+                    uint32_t applied, UdpResult result) {
+  uint32_t relays = 0;
+  if (tank < tankCount) {
+    for (uint8_t k = 0; k < tanks[tank].nch; k++) if (tanks[tank].ch[k].on) relays |= 1UL << k;
+  }
+  memset(tx, 0, sizeof(tx));
+  tx[0] = '9'; tx[1] = 'A'; tx[2] = UDP_VERSION; tx[3] = tank;
+  wr32(tx + 4, relays);
+  wr32(tx + 8, applied);
+  wr32(tx + 12, bootNonce);
+  wr64(tx + 16, seq);
+  tx[24] = result;
+  mac(tx, tx + UDP_SIGNED);
+  sendto(sock, tx, sizeof(tx), MSG_DONTWAIT, (const struct sockaddr*)&to, sizeof(to));
+}
+
+static void handleFrame(size_t len, const struct sockaddr_in& from) {
+  stats.rx++;
+  if (len != UDP_FRAME || rx[0] != '9' || rx[1] != 'U' || rx[2] != UDP_VERSION || !macOk(rx)) {
+    stats.badFrame++;
+    return;
+  }
+  uint8_t tank = rx[3];
+  uint32_t mask = rd32(rx + 4), levels = rd32(rx + 8), boot = rd32(rx + 12), ts = rd32(rx + 24);
+  uint64_t seq = rd64(rx + 16);
+  if (tank >= tankCount) { sendAck(from, tank, seq, 0, UDP_NO_TANK); return; }
+
+  // The nonce stops replays across reboots, sequence numbers within a boot
+  if (boot != bootNonce) { stats.replay++; sendAck(from, tank, seq, 0, UDP_BOOT); return; }
+  if (seq <= lastSeq[tank]) { stats.replay++; sendAck(from, tank, seq, 0, UDP_OLD_SEQ); return; }
+  time_t now = time(nullptr);
+  if (now > 1700000000 && (uint32_t)labs((long)(now - (time_t)ts)) > UDP_MAX_SKEW_S) {
+    sendAck(from, tank, seq, 0, UDP_TIME);
+    return;
+  }
+  lastSeq[tank] = seq;
+
+  Tank& t = tanks[tank];
+  mask &= (t.nch >= 32) ? 0xFFFFFFFFUL : ((1UL << t.nch) - 1);
+  if (mask) {
+    // ct in place (CSE clock, as ctNow()), so the ct String keeps its buffer
+    char ct[20] = "";
+    time_t cse = cseNow();
+    if (cse) {
+      struct tm tmv;
+      gmtime_r(&cse, &tmv);
+      strftime(ct, sizeof(ct), "%Y%m%dT%H%M%S", &tmv);
+    }
+    cmd.ct = ct;
+    commitRelays(t, mask, levels, cmd);
+    lanMirror(t, mask);
+    stats.applied++;
+  }
+  sendAck(from, tank, seq, mask, UDP_OK);
+}
+
+void udpControlService(uint32_t waitMs) {
+  if (sock < 0) { delay(waitMs); return; }
+
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(sock, &fds);
+  struct timeval tv = { 0, (long)waitMs * 1000 };
+  if (select(sock + 1, &fds, nullptr, nullptr, &tv) <= 0) return;
+
+  // Bounded drain, the rest of loop() still runs between bursts
+  for (uint8_t i = 0; i < 8; i++) {
+    struct sockaddr_in from;
+    socklen_t flen = sizeof(from);
+    ssize_t n = recvfrom(sock, rx, sizeof(rx), MSG_DONTWAIT, (struct sockaddr*)&from, &flen);
+    if (n < 0) return;
+    handleFrame((size_t)n, from);
+  }
+}
+
+UdpStats udpStats() {
+  return stats;
+}
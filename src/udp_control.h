@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+#include "tank.h"
+
+// =========================
+// Binary UDP control (LAN automation)
+// =========================
+// Command frame, 44 bytes, little-endian, on UDP_CONTROL_PORT:
+//   0  "9U"           magic
+//   2  u8  version    2
+//   3  u8  tank       index in AE_TABLE
+//   4  u32 mask       channels to drive (bit k = channel k of the tank)
+//   8  u32 levels     desired level per masked channel (pulse: 1 = fire)
+//   12 u32 boot       the device's boot nonce, from an earlier ack
+//   16 u64 seq        strictly increasing per tank within a boot
+//   24 u32 time       sender's epoch seconds
+//   28 u8[16]         HMAC-SHA256(UDP_CONTROL_KEY, bytes 0..27), truncated
+// Ack frame, 44 bytes, sent back to the source address:
+//   0  "9A" | u8 version | u8 tank | u32 relays (bitmask now on)
+//   8  u32 applied (channels commanded) | u32 boot | u64 seq
+//   24 u8 result | 3 x 0
+//   28 u8[16]         HMAC over bytes 0..27
+// result: 0 applied, 1 old seq (replay), 2 unknown tank, 3 time out of
+// window, 4 wrong boot (the ack carries the current nonce; resend with it).
+// Frames with a bad size, magic or HMAC are dropped without an ack.
+//
+// The boot nonce is random per boot and seq is only compared within it, so
+// a frame captured before a reboot is refused after it even though the seq
+// high-water mark lives in RAM. seq is 64-bit (udp_ctl.py sends epoch
+// microseconds), so it does not wrap.
+//
+// The socket is read without blocking into a static buffer, the HMAC
+// context is set up once, and the frame goes straight to commitRelays():
+// nothing is allocated per frame. loop() waits on the socket instead of a
+// fixed delay, so a frame is dispatched as soon as it arrives.
+
+void udpControlInit();
+
+// Handles pending frames, then waits up to waitMs for the next one
+void udpControlService(uint32_t waitMs);
+
+struct UdpStats {
+  uint32_t rx;
+  uint32_t applied;
+  uint32_t badFrame;  // size, magic or HMAC
+  uint32_t replay;    // old seq or wrong boot
+};
+UdpStats udpStats();
@@ -0,0 +1,173 @@
+#include "web_ui.h"
+#include "notify.h"
+#include "lan_api.h"
+#include "events.h"
+#include "journal.h"
+#include "m2m_client.h"
+#include <LittleFS.h>
+#include <lwip/sockets.h>
+
+static const char* const WWW_DIR = "/www";
+static const unsigned long WEB_STALL_MS = 10UL * 1000UL;
+
+struct Asset {
+  char path[24];   // request path without query, e.g. "/app.js"
+  char etag[20];   // quoted
+};
+
+struct Transfer {
+  WiFiClient sock;
+  File file;
+  bool used;
+  uint8_t buf[1024];
+  uint16_t len, off;
+  unsigned long lastProgressMs;
+};
+
+static Asset assets[WEB_MAX_ASSETS];
+static uint8_t assetCount = 0;
+static Transfer transfers[WEB_MAX_TRANSFERS];
+
+static const char* contentType(const String& path) {
+  if (path.endsWith(".html")) return "text/html; charset=utf-8";
+  if (path.endsWith(".js"))   return "application/javascript";
+  if (path.endsWith(".css"))  return "text/css";
+  if (path.endsWith(".svg"))  return "image/svg+xml";
+  if (path.endsWith(".json")) return "application/json";
+  return "application/octet-stream";
+}
+
+// /www/etags: one "<path> <etag>" line per asset, written by web_build.py
+static void loadAssets() {
+  File f = LittleFS.open(String(WWW_DIR) + "/etags", "r");
+  if (!f) { Serial.println("[WEB] no dashboard on flash"); return; }
+  while (f.available() && assetCount < WEB_MAX_ASSETS) {
+    String line = f.readStringUntil('\n');
+    line.trim();
+    int sp = line.indexOf(' ');
+    if (sp <= 0) continue;
+    Asset& a = assets[assetCount++];
+    strlcpy(a.path, line.substring(0, sp).c_str(), sizeof(a.path));
+    snprintf(a.etag, sizeof(a.etag), "\"%s\"", line.substring(sp + 1).c_str());
+  }
+  f.close();
+  Serial.printf("[WEB] %u assets\n", assetCount);
+}
+
+static const Asset* findAsset(const String& uri) {
+  String path = uri == "/" ? String("/index.html") : uri;
+  for (uint8_t i = 0; i < assetCount; i++) if (path == assets[i].path) return &assets[i];
+  return nullptr;
+}
+
+// =========================
+// Static files
+// =========================
+static void handleStatic() {
+  const Asset* a = findAsset(server.uri());
+  if (!a) { server.send(404, "text/plain", "not found"); return; }
+
+  bool index = !strcmp(a->path, "/index.html");
+  const char* cache = index ? "no-cache" : "public, max-age=31536000, immutable";
+  if (server.header("If-None-Match") == a->etag) {
+    server.sendHeader("ETag", a->etag);
+    server.sendHeader("Cache-Control", cache);
+    server.send(304);
+    return;
+  }
+
+  Transfer* slot = nullptr;
+  for (Transfer& t : transfers) if (!t.used) { slot = &t; break; }
+  if (!slot) {
+    server.sendHeader("Retry-After", "1");
+    server.send(503, "text/plain", "busy");
+    return;
+  }
+  File f = LittleFS.open(String(WWW_DIR) + a->path + ".gz", "r");
+  if (!f) { server.send(404, "text/plain", "not found"); return; }
+
+  slot->sock = takeClient();
+  if (slot->sock.fd() < 0) { f.close(); slot->sock = WiFiClient(); return; }
+  slot->file = f;
+  slot->used = true;
+  slot->len = snprintf((char*)slot->buf, sizeof(slot->buf),
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: %s\r\n"
+                       "Content-Encoding: gzip\r\n"
+                       "Content-Length: %u\r\n"
+                       "ETag: %s\r\n"
+                       "Cache-Control: %s\r\n"
+                       "Connection: close\r\n\r\n",
+                       contentType(a->path), (unsigned)f.size(), a->etag, cache);
+  slot->off = 0;
+  slot->lastProgressMs = millis();
+}
+
+static void finish(Transfer& t) {
+  t.file.close();
+  t.sock.stop();
+  t.sock = WiFiClient();
+  t.used = false;
+}
+
+// Moves what the socket takes right now, refilling from flash 1 KB at a time
+static bool pump(Transfer& t, unsigned long now) {
+  for (uint8_t rounds = 0; rounds < 4; rounds++) {
+    if (t.off >= t.len) {
+      int n = t.file.read(t.buf, sizeof(t.buf));
+      if (n <= 0) return false;  // done
+      t.len = n;
+      t.off = 0;
+    }
+    ssize_t w = send(t.sock.fd(), t.buf + t.off, t.len - t.off, MSG_DONTWAIT);
+    if (w < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+      return now - t.lastProgressMs < WEB_STALL_MS;
+    }
+    t.off += w;
+    t.lastProgressMs = now;
+    if (t.off < t.len) return true;
+  }
+  return true;
+}
+
+void webService() {
+  unsigned long now = millis();
+  for (Transfer& t : transfers) {
+    if (t.used && (!t.sock.connected() || !pump(t, now))) finish(t);
+  }
+}
+
+// =========================
+// JSON state
+// =========================
+static void handleState() {
+  if (!lanAuthorized()) { server.send(401, "text/plain", "unauthorized"); return; }
+  EventStats ev = eventStats();
+  String body = "{\"up\":" + String(millis() / 1000) +
+                ",\"heap\":" + String(ESP.getFreeHeap()) +
+                ",\"jrnl\":" + String(journalBacklogBytes()) +
+                ",\"cse\":" + m2mEndpointStats() +
+                ",\"sse\":" + String(ev.clients) + ",\"tanks\":[";
+  for (uint8_t i = 0; i < tankCount; i++) {
+    const Tank& t = tanks[i];
+    if (i) body += ",";
+    body += String("{\"ae\":\"") + t.ae + "\",\"cfg\":" + String(t.cfgVersion) + ",\"ch\":[";
+    for (uint8_t k = 0; k < t.nch; k++) {
+      const Channel& c = t.ch[k];
+      if (k) body += ",";
+      body += String("{\"cnt\":\"") + c.cnt + "\",\"name\":\"" + c.name + "\",\"on\":" +
+              (c.on ? "1" : "0") + ",\"pulse\":" + (c.kind == CH_PULSE ? "1" : "0") + "}";
+    }
+    body += "]}";
+  }
+  body += "]}";
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", body);
+}
+
+void webInit() {
+  loadAssets();
+  server.on("/state", HTTP_GET, handleState);
+  server.onNotFound(handleStatic);
+}
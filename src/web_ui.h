@@ -0,0 +1,27 @@
+#pragma once
+#include <Arduino.h>
+
+// =========================
+// Local dashboard (LittleFS) and JSON state
+// =========================
+// Assets are gzipped at build time by tools/web_build.py (web/ -> data/www)
+// and uploaded with the filesystem image. /www/etags lists each asset with
+// the hash of its .gz file, which is its strong ETag; index.html refers to
+// the other assets with ?v=<etag>, so they can be cached for a year and
+// index.html is always revalidated (304 when unchanged).
+// A response is streamed from flash in small pieces from loop() on the
+// detached connection (non-blocking writes), so a page load does not hold
+// the notify server. At most WEB_MAX_TRANSFERS run at once.
+//
+//   GET /             dashboard
+//   GET /<asset>      other assets listed in /www/etags
+//   GET /state        {"up":s,"heap":..,"tanks":[{"ae":..,"ch":[...]}],...}
+// /state needs the LAN token, the static files do not.
+
+static const uint8_t WEB_MAX_TRANSFERS = 2;
+static const uint8_t WEB_MAX_ASSETS = 8;
+
+void webInit();
+
+// Streams pending responses, call every loop
+void webService();
@@ -0,0 +1,49 @@
+#pragma once
+// Host stand-ins for the parts of the Arduino core used by the modules under
+// test ([env:native], see platformio.ini)
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#define LOW  0
+#define HIGH 1
+inline void digitalWrite(int, int) {}
+
+// Advanced by the tests, restarts at 0 on a simulated reboot
+extern unsigned long hostMillis;
+inline unsigned long millis() { return hostMillis; }
+
+class String : public std::string {
+public:
+  String() {}
+  String(const char* s) : std::string(s ? s : "") {}
+  String(const std::string& s) : std::string(s) {}
+  unsigned length() const { return (unsigned)size(); }
+};
+
+struct HostSerial {
+  int printf(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+  void println(const char* s) { puts(s); }
+};
+static HostSerial Serial;
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t n = strlen(src);
+  if (size) {
+    size_t k = n < size - 1 ? n : size - 1;
+    memcpy(dst, src, k);
+    dst[k] = 0;
+  }
+  return n;
+}
+#endif
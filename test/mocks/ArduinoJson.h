@@ -0,0 +1,3 @@
+#pragma once
+// Only the names that headers of the modules under test mention
+class JsonVariant {};
@@ -0,0 +1,44 @@
+#pragma once
+// NVS stand-in: one map for every namespace, kept across simulated reboots
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+struct HostNvs {
+  static std::map<std::string, std::vector<uint8_t>>& data() {
+    static std::map<std::string, std::vector<uint8_t>> d;
+    return d;
+  }
+  static unsigned& writes() {
+    static unsigned n = 0;
+    return n;
+  }
+};
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false) {
+    ns = name;
+    ro = readOnly;
+    return true;
+  }
+  void end() {}
+  size_t putBytes(const char* key, const void* value, size_t len) {
+    if (ro) return 0;
+    const uint8_t* p = (const uint8_t*)value;
+    HostNvs::data()[ns + "/" + key].assign(p, p + len);
+    HostNvs::writes()++;
+    return len;
+  }
+  size_t getBytes(const char* key, void* buf, size_t maxLen) {
+    auto it = HostNvs::data().find(ns + "/" + key);
+    if (it == HostNvs::data().end() || it->second.size() > maxLen) return 0;
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+
+private:
+  std::string ns;
+  bool ro = false;
+};
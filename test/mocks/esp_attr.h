@@ -0,0 +1,3 @@
+#pragma once
+// RTC memory is an ordinary static on the host; tests clear it for a power loss
+#define RTC_NOINIT_ATTR
@@ -0,0 +1,187 @@
+// Pulse (feeder) watermark across simulated reboots: which copy is restored,
+// how often NVS is written, and what a full RTC table does.
+//   pio test -e native
+#include <unity.h>
+#include "../../src/pulse_mark.cpp"
+#include "../../src/cse_time.cpp"
+
+unsigned long hostMillis = 0;
+
+static Tank tank;
+
+static void makeTank(Tank& t, const char* ae, uint8_t pulses) {
+  String name = ae;
+  t = Tank{};
+  strlcpy(t.ae, name.c_str(), sizeof(t.ae));
+  for (uint8_t k = 0; k < pulses; k++) {
+    Channel& c = t.ch[t.nch++];
+    snprintf(c.cnt, sizeof(c.cnt), "feed%u", k);
+    snprintf(c.name, sizeof(c.name), "FEEDER%u", k);
+    c.kind = CH_PULSE;
+  }
+  Channel& led = t.ch[t.nch++];
+  strlcpy(led.cnt, "LED", sizeof(led.cnt));
+  led.kind = CH_LEVEL;
+}
+
+static void pulse(Tank& t, uint8_t k, const char* ri, const char* ct) {
+  t.ch[k].lastRi = ri;
+  t.ch[k].lastCt = ct;
+  pulseMarkNote(t, t.ch[k]);
+}
+
+// Reset: RAM is gone (module state, channel table, millis), RTC memory stays
+static void reboot(Tank& t, uint8_t pulses) {
+  memset(nvsPending, 0, sizeof(nvsPending));
+  lastNvsMs = 0;
+  nvsWritten = false;
+  hostMillis = 0;
+  makeTank(t, t.ae, pulses);
+  pulseMarkRestore(t);
+}
+
+// Power loss: RTC memory comes back as garbage too
+static void powerCycle(Tank& t, uint8_t pulses) {
+  memset(&rtcMarks, 0xA5, sizeof(rtcMarks));
+  reboot(t, pulses);
+}
+
+void setUp() {
+  HostNvs::data().clear();
+  HostNvs::writes() = 0;
+  memset(&rtcMarks, 0, sizeof(rtcMarks));
+  hostMillis = 0;
+  makeTank(tank, "AE-Actuator", 1);
+  reboot(tank, 1);
+}
+
+void tearDown() {}
+
+void test_first_mark_goes_to_nvs_at_once() {
+  hostMillis = 1000;
+  pulse(tank, 0, "cin1", "20250101T080000");
+  TEST_ASSERT_EQUAL_UINT(1, HostNvs::writes());
+  powerCycle(tank, 1);
+  TEST_ASSERT_EQUAL_STRING("cin1", tank.ch[0].lastRi.c_str());
+  TEST_ASSERT_EQUAL_STRING("20250101T080000", tank.ch[0].lastCt.c_str());
+}
+
+void test_reset_prefers_newer_rtc_copy() {
+  hostMillis = 1000;
+  pulse(tank, 0, "cin1", "20250101T080000");
+  hostMillis = 11000;  // within the NVS gap: RTC only
+  pulse(tank, 0, "cin2", "20250101T080010");
+  TEST_ASSERT_EQUAL_UINT(1, HostNvs::writes());
+  reboot(tank, 1);
+  TEST_ASSERT_EQUAL_STRING("cin2", tank.ch[0].lastRi.c_str());
+}
+
+void test_power_loss_falls_back_to_nvs() {
+  hostMillis = 1000;
+  pulse(tank, 0, "cin1", "20250101T080000");
+  hostMillis = 11000;
+  pulse(tank, 0, "cin2", "20250101T080010");
+  powerCycle(tank, 1);
+  // The deferred mark was never flushed: the last one in NVS is restored
+  TEST_ASSERT_EQUAL_STRING("cin1", tank.ch[0].lastRi.c_str());
+}
+
+void test_corrupt_rtc_slot_falls_back_to_nvs() {
+  hostMillis = 1000;
+  pulse(tank, 0, "cin1", "20250101T080000");
+  rtcMarks.s[0].m.ri[0] ^= 1;  // CRC no longer matches
+  reboot(tank, 1);
+  TEST_ASSERT_EQUAL_STRING("cin1", tank.ch[0].lastRi.c_str());
+}
+
+void test_nvs_gap_and_pending_flush() {
+  hostMillis = 1000;
+  pulse(tank, 0, "cin1", "20250101T080000");
+  hostMillis = 5000;
+  pulse(tank, 0, "cin2", "20250101T080004");
+  hostMillis = 9000;
+  pulse(tank, 0, "cin3", "20250101T080008");
+  TEST_ASSERT_EQUAL_UINT(1, HostNvs::writes());
+
+  hostMillis = 1000 + PULSE_MARK_NVS_GAP_MS - 1;
+  pulseMarkService();
+  TEST_ASSERT_EQUAL_UINT(1, HostNvs::writes());
+  hostMillis = 1000 + PULSE_MARK_NVS_GAP_MS;
+  pulseMarkService();
+  TEST_ASSERT_EQUAL_UINT(2, HostNvs::writes());
+  pulseMarkService();
+  TEST_ASSERT_EQUAL_UINT(2, HostNvs::writes());  // nothing left pending
+
+  // The flushed copy is the latest mark
+  powerCycle(tank, 1);
+  TEST_ASSERT_EQUAL_STRING("cin3", tank.ch[0].lastRi.c_str());
+}
+
+void test_unchanged_mark_is_not_rewritten() {
+  hostMillis = 1000;
+  pulse(tank, 0, "cin1", "20250101T080000");
+  hostMillis = 1000 + 2 * PULSE_MARK_NVS_GAP_MS;
+  pulse(tank, 0, "cin1", "20250101T080000");
+  pulseMarkService();
+  TEST_ASSERT_EQUAL_UINT(1, HostNvs::writes());
+}
+
+void test_repeated_reboots_keep_the_mark() {
+  hostMillis = 1000;
+  pulse(tank, 0, "cin1", "20250101T080000");
+  for (int i = 0; i < 5; i++) {
+    reboot(tank, 1);
+    TEST_ASSERT_EQUAL_STRING("cin1", tank.ch[0].lastRi.c_str());
+    // what applyCommand does again for the same CIN found by the boot poll
+    pulseMarkNote(tank, tank.ch[0]);
+    pulseMarkService();
+  }
+  powerCycle(tank, 1);
+  TEST_ASSERT_EQUAL_STRING("cin1", tank.ch[0].lastRi.c_str());
+  TEST_ASSERT_EQUAL_UINT(1, HostNvs::writes());
+  TEST_ASSERT_EQUAL_STRING("", tank.ch[1].lastRi.c_str());  // level channel untouched
+}
+
+void test_full_rtc_evicts_oldest_and_keeps_it_in_nvs() {
+  static Tank more;
+  makeTank(more, "AE-Actuator2", 5);
+  makeTank(tank, "AE-Actuator", 5);
+
+  // 10 pulse channels, 8 RTC slots; all within one NVS gap after the first
+  char ri[8], ct[20];
+  hostMillis = 1000;
+  for (uint8_t k = 0; k < 5; k++) {
+    snprintf(ri, sizeof(ri), "a%u", k);
+    snprintf(ct, sizeof(ct), "20250101T0800%02u", k);
+    pulse(tank, k, ri, ct);
+    hostMillis += 100;
+  }
+  for (uint8_t k = 0; k < 5; k++) {
+    snprintf(ri, sizeof(ri), "b%u", k);
+    snprintf(ct, sizeof(ct), "20250101T0801%02u", k);
+    pulse(more, k, ri, ct);
+    hostMillis += 100;
+  }
+
+  reboot(tank, 5);
+  reboot(more, 5);
+  for (uint8_t k = 0; k < 5; k++) {
+    snprintf(ri, sizeof(ri), "a%u", k);
+    TEST_ASSERT_EQUAL_STRING(ri, tank.ch[k].lastRi.c_str());
+    snprintf(ri, sizeof(ri), "b%u", k);
+    TEST_ASSERT_EQUAL_STRING(ri, more.ch[k].lastRi.c_str());
+  }
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_mark_goes_to_nvs_at_once);
+  RUN_TEST(test_reset_prefers_newer_rtc_copy);
+  RUN_TEST(test_power_loss_falls_back_to_nvs);
+  RUN_TEST(test_corrupt_rtc_slot_falls_back_to_nvs);
+  RUN_TEST(test_nvs_gap_and_pending_flush);
+  RUN_TEST(test_unchanged_mark_is_not_rewritten);
+  RUN_TEST(test_repeated_reboots_keep_the_mark);
+  RUN_TEST(test_full_rtc_evicts_oldest_and_keeps_it_in_nvs);
+  return UNITY_END();
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""Read-only configuration image for the cfgimg partition (see src/cfg_image.h).
+
+  cfg_image.py build <source.json> <out.bin>     build the image
+  cfg_image.py dump  <image.bin>                 list tables and keys
+
+Source layout (every section optional):
+  {"version": 1,
+   "config": {"AE-Actuator": {"v": 1, "channels": [...]}},
+   "scenes": {"AE-Actuator": {"night": {"LED": 0, "pump": 1}}}}
+
+Flash it to the cfgimg offset of partitions.csv:
+  esptool.py write_flash 0x3D0000 out.bin
+"""
+import json
+import struct
+import sys
+import zlib
+
+MAGIC = b"9PC1"
+HDR = 32
+DIR_ENTRY = 32
+PART_SIZE = 0x20000
+
+CONFIG_KEY = 32   # <ae>, as Tank::ae
+SCENE_KEY = 48    # <ae>/<id>
+
+
+def _align(n, a=4):
+    return (n + a - 1) // a * a
+
+
+def _key(k, size):
+    b = k.encode()
+    if len(b) >= size:
+        raise ValueError("key too long for %d bytes: %s" % (size, k))
+    return b.ljust(size, b"\0")
+
+
+def _compact(obj):
+    return json.dumps(obj, separators=(",", ":")).encode()
+
+
+def _tables(src):
+    """(name, keyLen, [(key, bytes)], blob) for every section present."""
+    tables = []
+    if src.get("config"):
+        tables.append(("config", CONFIG_KEY,
+                       [(ae, _compact(c)) for ae, c in src["config"].items()], True))
+    if src.get("scenes"):
+        tables.append(("scene", SCENE_KEY,
+                       [(ae + "/" + sid, _compact(vec))
+                        for ae, scenes in src["scenes"].items() for sid, vec in scenes.items()], True))
+    return tables
+
+
+def build(src):
+    tables = _tables(src)
+
+    # Record area: directory, then each table (sorted, 4-byte aligned)
+    off = _align(HDR + DIR_ENTRY * len(tables))
+    layout = []
+    for name, klen, recs, blob in tables:
+        recs = sorted(recs, key=lambda r: _key(r[0], klen))
+        rsize = klen + (8 if blob else len(recs[0][1]))
+        layout.append((name, off, klen, rsize, recs, blob))
+        off = _align(off + rsize * len(recs))
+
+    # Blob area after the records, each blob NUL-terminated
+    out = bytearray(off)
+    for i, (name, toff, klen, rsize, recs, blob) in enumerate(layout):
+        struct.pack_into("<16sIIHHI", out, HDR + i * DIR_ENTRY,
+                         name.encode(), toff, len(recs), rsize, klen, 0)
+        for j, (k, v) in enumerate(recs):
+            if blob:
+                pos = len(out)
+                out += v + b"\0"
+                out += b"\0" * (_align(len(out)) - len(out))
+                v = struct.pack("<II", pos, len(v))
+            p = toff + j * rsize
+            out[p:p + rsize] = _key(k, klen) + v
+
+    if len(out) > PART_SIZE:
+        raise ValueError("image is %d bytes, partition holds %d" % (len(out), PART_SIZE))
+    crc = zlib.crc32(bytes(out[HDR:])) & 0xFFFFFFFF
+    struct.pack_into("<4sIIIHH", out, 0, MAGIC, src.get("version", 1), len(out), crc, len(layout), 0)
+    return bytes(out)
+
+
+def dump(img):
+    magic, version, size, crc, ntables, _ = struct.unpack_from("<4sIIIHH", img, 0)
+    if magic != MAGIC:
+        raise ValueError("bad magic")
+    ok = zlib.crc32(img[HDR:size]) & 0xFFFFFFFF == crc
+    print("v%d, %d bytes, %d tables, crc %s" % (version, size, ntables, "ok" if ok else "BAD"))
+    for i in range(ntables):
+        name, toff, count, rsize, klen, _ = struct.unpack_from("<16sIIHHI", img, HDR + i * DIR_ENTRY)
+        print("  %-8s %4d x %4d bytes" % (name.rstrip(b"\0").decode(), count, rsize))
+        for j in range(count):
+            p = toff + j * rsize
+            print("    " + img[p:p + klen].rstrip(b"\0").decode())
+
+
+def main(argv):
+    if len(argv) >= 4 and argv[1] == "build":
+        img = build(json.load(open(argv[2])))
+        open(argv[3], "wb").write(img)
+        print("%d bytes" % len(img), file=sys.stderr)
+        return 0
+    if len(argv) >= 3 and argv[1] == "dump":
+        dump(open(argv[2], "rb").read())
+        return 0
+    print(__doc__, file=sys.stderr)
+    return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
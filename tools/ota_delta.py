@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Delta OTA images for the actuator firmware (see src/ota.h for the format).
+
+  ota_delta.py make  <base.bin> <target.bin> <out.delta> <key>   build a delta
+  ota_delta.py apply <base.bin> <in.delta>   <out.bin>   <key>   decode (reference)
+  ota_delta.py serve <dir> [port]                                local update server
+
+`make` signs the header with <key> (OTA_SIGN_KEY in app_config.h) and
+prints the con for the OTA CIN. `serve` is a plain HTTP server for the
+LAN (or a bench stand-in): point the CIN url at http://<host>:<port>/<file>.
+"""
+import hashlib
+import hmac
+import http.server
+import functools
+import struct
+import sys
+import zlib
+
+MAGIC = b"9PD2"
+SIGNED = 76    # header bytes covered by the HMAC
+HDR = SIGNED + 32
+OP_END, OP_COPY, OP_ADD, OP_DIFF = 0, 1, 2, 3
+
+KEY = 16        # bytes hashed per index entry
+STRIDE = 4      # base positions indexed
+MIN_MATCH = 24  # shorter matches are cheaper as literals
+
+
+def _index(base):
+    idx = {}
+    for p in range(0, len(base) - KEY + 1, STRIDE):
+        idx.setdefault(base[p:p + KEY], p)
+    return idx
+
+
+def _emit_gap(ops, gap, base, prev_end):
+    """Literal run: DIFF against the base right after the previous match when
+    the bytes mostly line up (shifted code), ADD otherwise."""
+    if not gap:
+        return
+    if prev_end is not None and prev_end + len(gap) <= len(base):
+        ref = base[prev_end:prev_end + len(gap)]
+        diff = bytes((g - r) & 0xFF for g, r in zip(gap, ref))
+        if diff.count(0) * 2 >= len(diff):
+            ops.append(struct.pack("<BII", OP_DIFF, prev_end, len(gap)) + diff)
+            return
+    ops.append(struct.pack("<BI", OP_ADD, len(gap)) + gap)
+
+
+def encode_ops(base, target):
+    idx = _index(base)
+    ops = []
+    i = lit_start = 0
+    prev_end = None
+    n = len(target)
+    while i + KEY <= n:
+        p = idx.get(target[i:i + KEY])
+        if p is None:
+            i += 1
+            continue
+        # extend forward, then backward into the pending literals
+        ln = KEY
+        while i + ln < n and p + ln < len(base) and target[i + ln] == base[p + ln]:
+            ln += 1
+        back = 0
+        while i - back > lit_start and p - back > 0 and target[i - back - 1] == base[p - back - 1]:
+            back += 1
+        if ln + back < MIN_MATCH:
+            i += 1
+            continue
+        _emit_gap(ops, target[lit_start:i - back], base, prev_end)
+        ops.append(struct.pack("<BII", OP_COPY, p - back, ln + back))
+        i += ln
+        lit_start = i
+        prev_end = p + ln
+    _emit_gap(ops, target[lit_start:], base, prev_end)
+    ops.append(bytes([OP_END]))
+    return b"".join(ops)
+
+
+def make(base, target, key):
+    header = (MAGIC + struct.pack("<I", len(base)) + hashlib.sha256(base).digest() +
+              struct.pack("<I", len(target)) + hashlib.sha256(target).digest())
+    header += hmac.new(key, header, hashlib.sha256).digest()
+    return header + zlib.compress(encode_ops(base, target), 9)
+
+
+def apply(base, delta, key):
+    if delta[:4] != MAGIC:
+        raise ValueError("bad magic")
+    if not hmac.compare_digest(hmac.new(key, delta[:SIGNED], hashlib.sha256).digest(),
+                               delta[SIGNED:HDR]):
+        raise ValueError("bad signature")
+    base_size, = struct.unpack_from("<I", delta, 4)
+    target_size, = struct.unpack_from("<I", delta, 40)
+    if hashlib.sha256(base[:base_size]).digest() != delta[8:40]:
+        raise ValueError("delta is for another base image")
+    ops = zlib.decompress(delta[HDR:])
+    out = bytearray()
+    k = 0
+    while True:
+        op = ops[k]
+        k += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            off, ln = struct.unpack_from("<II", ops, k)
+            k += 8
+            out += base[off:off + ln]
+        elif op == OP_ADD:
+            ln, = struct.unpack_from("<I", ops, k)
+            k += 4
+            out += ops[k:k + ln]
+            k += ln
+        elif op == OP_DIFF:
+            off, ln = struct.unpack_from("<II", ops, k)
+            k += 8
+            out += bytes((a + b) & 0xFF for a, b in zip(base[off:off + ln], ops[k:k + ln]))
+            k += ln
+        else:
+            raise ValueError("bad op %d" % op)
+    if len(out) != target_size or hashlib.sha256(out).digest() != delta[44:76]:
+        raise ValueError("sha256 mismatch")
+    return bytes(out)
+
+
+def main(argv):
+    if len(argv) >= 6 and argv[1] == "make":
+        base = open(argv[2], "rb").read()
+        target = open(argv[3], "rb").read()
+        key = argv[5].encode()
+        delta = make(base, target, key)
+        assert apply(base, delta, key) == target
+        open(argv[4], "wb").write(delta)
+        print("delta %d bytes for a %d byte image (%.1fx smaller)"
+              % (len(delta), len(target), len(target) / max(1, len(delta))), file=sys.stderr)
+        print('{"url":"http://<host>:8000/%s"}' % argv[4].split("/")[-1])
+        return 0
+    if len(argv) >= 6 and argv[1] == "apply":
+        base = open(argv[2], "rb").read()
+        open(argv[4], "wb").write(apply(base, open(argv[3], "rb").read(), argv[5].encode()))
+        return 0
+    if len(argv) >= 3 and argv[1] == "serve":
+        port = int(argv[3]) if len(argv) > 3 else 8000
+        handler = functools.partial(http.server.SimpleHTTPRequestHandler, directory=argv[2])
+        http.server.ThreadingHTTPServer(("", port), handler).serve_forever()
+        return 0
+    print(__doc__, file=sys.stderr)
+    return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
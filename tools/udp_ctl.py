@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Send one binary UDP control frame and print the ack (see src/udp_control.h).
+
+  udp_ctl.py <host> <key> <tank> <mask> <levels> [port]
+
+mask/levels take ints (0x.. allowed); bit k is channel k of the tank.
+The sequence number is the current time in microseconds (64-bit, so it
+only grows and does not wrap). Frames carry the device's boot nonce; the
+first frame is sent with 0, the device answers "wrong boot" with the
+current nonce in its ack, and the frame is sent again with it.
+"""
+import hashlib
+import hmac
+import socket
+import struct
+import sys
+import time
+
+RESULTS = {0: "applied", 1: "old seq", 2: "unknown tank", 3: "time out of window",
+           4: "wrong boot"}
+WRONG_BOOT = 4
+
+
+def frame(key, tank, mask, levels, boot, seq, ts):
+    body = b"9U" + struct.pack("<BBIIIQI", 2, tank, mask, levels, boot, seq, ts)
+    return body + hmac.new(key, body, hashlib.sha256).digest()[:16]
+
+
+def exchange(s, key, addr, tank, mask, levels, boot):
+    now = time.time()
+    seq = int(now * 1000000)
+    t0 = time.perf_counter()
+    s.sendto(frame(key, tank, mask, levels, boot, seq, int(now)), addr)
+    ack, _ = s.recvfrom(64)
+    rtt = (time.perf_counter() - t0) * 1000
+
+    if len(ack) != 44 or ack[:2] != b"9A" or \
+            hmac.new(key, ack[:28], hashlib.sha256).digest()[:16] != ack[28:]:
+        return None
+    _, tank, relays, applied, boot, seq, result = struct.unpack_from("<BBIIIQB", ack, 2)
+    return seq, relays, applied, boot, result, rtt
+
+
+def main(argv):
+    if len(argv) < 6:
+        print(__doc__, file=sys.stderr)
+        return 2
+    host, key = argv[1], argv[2].encode()
+    tank, mask, levels = int(argv[3], 0), int(argv[4], 0), int(argv[5], 0)
+    port = int(argv[6]) if len(argv) > 6 else 9750
+
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.settimeout(1.0)
+    boot = 0
+    for _ in range(2):
+        r = exchange(s, key, (host, port), tank, mask, levels, boot)
+        if r is None:
+            print("bad ack", file=sys.stderr)
+            return 1
+        seq, relays, applied, boot, result, rtt = r
+        if result != WRONG_BOOT:
+            break
+    print("seq %d: %s, applied 0x%x, relays 0x%x (%.1f ms)"
+          % (seq, RESULTS.get(result, result), applied, relays, rtt))
+    return 0 if result == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
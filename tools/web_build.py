@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Gzip the dashboard (web/) into data/www for the LittleFS image.
+
+  web_build.py [web_dir] [out_dir]      defaults: web data/www
+
+Also runs as a PlatformIO pre-script (extra_scripts in platformio.ini), so
+`pio run -t uploadfs` always ships fresh assets. Output:
+  <asset>.gz   gzip -9, mtime 0 (same input, same bytes, same ETag)
+  etags        "/<asset> <etag>" per line, etag = sha256 of the .gz (16 hex)
+index.html references to the other assets get ?v=<etag> appended, so they
+can be cached as immutable.
+"""
+import gzip
+import hashlib
+import os
+import sys
+
+
+def _gz(data):
+    return gzip.compress(data, 9, mtime=0)
+
+
+def _etag(gz):
+    return hashlib.sha256(gz).hexdigest()[:16]
+
+
+def build(src, out):
+    os.makedirs(out, exist_ok=True)
+    names = sorted(n for n in os.listdir(src) if os.path.isfile(os.path.join(src, n)))
+    tags = {}
+    for name in names:
+        if name == "index.html":
+            continue
+        gz = _gz(open(os.path.join(src, name), "rb").read())
+        open(os.path.join(out, name + ".gz"), "wb").write(gz)
+        tags[name] = _etag(gz)
+
+    if "index.html" in names:
+        html = open(os.path.join(src, "index.html"), "rb").read()
+        for name, tag in tags.items():
+            for quote in (b'"', b"'"):
+                html = html.replace(quote + name.encode() + quote,
+                                    quote + ("%s?v=%s" % (name, tag)).encode() + quote)
+        gz = _gz(html)
+        open(os.path.join(out, "index.html.gz"), "wb").write(gz)
+        tags["index.html"] = _etag(gz)
+
+    with open(os.path.join(out, "etags"), "w") as f:
+        for name in sorted(tags):
+            f.write("/%s %s\n" % (name, tags[name]))
+    total = sum(os.path.getsize(os.path.join(out, n + ".gz")) for n in tags)
+    print("web: %d assets, %d bytes gzipped -> %s" % (len(tags), total, out))
+
+
+if __name__ == "__main__":
+    build(sys.argv[1] if len(sys.argv) > 1 else "web",
+          sys.argv[2] if len(sys.argv) > 2 else os.path.join("data", "www"))
+else:
+    # PlatformIO pre-script
+    Import("env")  # noqa: F821
+    root = env.subst("$PROJECT_DIR")  # noqa: F821
+    build(os.path.join(root, "web"), os.path.join(root, "data", "www"))
@@ -0,0 +1,63 @@
+// Dashboard: /state for the snapshot, /events for live changes, /ch to switch
+let token = localStorage.getItem("token") || "";
+if (!token) { token = prompt("LAN API token") || ""; localStorage.setItem("token", token); }
+const auth = { headers: { Authorization: "Bearer " + token } };
+const buttons = {};
+
+function setButton(ae, cnt, on) {
+  const b = buttons[ae + "/" + cnt];
+  if (!b) return;
+  b.classList.toggle("on", !!on);
+  b.textContent = on ? "ON" : "OFF";
+  b.dataset.on = on ? "1" : "0";
+}
+
+function render(state) {
+  const main = document.getElementById("tanks");
+  main.textContent = "";
+  for (const t of state.tanks) {
+    const sec = document.createElement("section");
+    const h = document.createElement("h2");
+    h.textContent = t.ae + (t.cfg ? " (cfg v" + t.cfg + ")" : "");
+    sec.appendChild(h);
+    for (const c of t.ch) {
+      const row = document.createElement("div");
+      row.className = "ch";
+      const label = document.createElement("span");
+      label.textContent = c.name + (c.pulse ? " (pulse)" : "");
+      const b = document.createElement("button");
+      b.onclick = () => {
+        const on = c.pulse || b.dataset.on !== "1";
+        fetch("/ch/" + t.ae + "/" + c.cnt, { ...auth, method: "PUT", body: on ? "on" : "off" });
+      };
+      buttons[t.ae + "/" + c.cnt] = b;
+      row.append(label, b);
+      sec.appendChild(row);
+      setButton(t.ae, c.cnt, c.on);
+    }
+    main.appendChild(sec);
+  }
+  document.getElementById("info").textContent =
+    "up " + state.up + " s, heap " + state.heap + " B, journal " + state.jrnl + " B";
+}
+
+async function load() {
+  const r = await fetch("/state", auth);
+  if (r.status === 401) { localStorage.removeItem("token"); location.reload(); return; }
+  render(await r.json());
+}
+
+function live() {
+  const status = document.getElementById("status");
+  // EventSource cannot set headers, /events takes the token in the query
+  const es = new EventSource("/events?token=" + encodeURIComponent(token));
+  es.onopen = () => { status.textContent = "live"; load(); };
+  es.onerror = () => { status.textContent = "reconnecting..."; };
+  es.onmessage = (m) => {
+    const e = JSON.parse(m.data);
+    setButton(e.ae, e.ch, e.on);
+    if (e.lost) load();
+  };
+}
+
+load().then(live);